@@ -2,10 +2,14 @@
 #include <tlx/cmdline_parser.hpp>
 
 #include <phobic_gpu_mphf.hpp>
+#include <app/tlb_counter.h>
 #include <omp.h>
 #include <vector>
 #include <iostream>
 #include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 
 using namespace phobicgpu;
 
@@ -23,31 +27,76 @@ std::string partitionencoderbase = "c";
 std::string hashfunctionstring = "xx";
 std::string keytypestring = "string";
 bool validate = false;
+bool cpuBuild = false;
+size_t transferChunkSize = 0;
+bool deviceHashing = false;
+std::string traceFile;
+bool noHugePages = false;
+bool deviceQuery = false;
+bool positionOutput = false;
+double loadFactor = 1.0;
+bool noRemap = false;
 
 std::random_device rd;
 std::mt19937_64 gen(rd());
 std::uniform_int_distribution<uint32_t> dis;
 
+// whether lookup_batch of g agrees with operator() of f on all keys
+template<typename mphf, typename keytype>
+bool batchMatches(const mphf &g, const mphf &f, const std::vector<keytype> &keys) {
+    std::vector<uint64_t> outputs(keys.size());
+    g.lookup_batch(keys.data(), keys.size(), outputs.data());
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (outputs[i] != f(keys[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 template<typename pilotencoder, typename offsetencoder, typename hashfunction, typename keytype>
 bool benchmark(const std::vector<keytype> &keys) {
     MPHFconfig conf(lambda, partitionSize);
-    MPHFbuilder builder(conf);
+    conf.setLoadFactor(loadFactor, !noRemap);
     MPHF<pilotencoder, offsetencoder, hashfunction> f;
 
     if constexpr (std::is_same<pilotencoder, interleaved_encoder_dual<rice, compact>>::value) {
         f.getPilotEncoder().setEncoderTradeoff(tradeoff);
     }
 
+    std::vector<uint32_t> positions;
     HostTimer timerConstruct;
-    HostTimer timerInternal = builder.build(keys, f);
+    HostTimer timerInternal;
+    if (cpuBuild) {
+        CPUMPHFbuilder builder(conf);
+        if (positionOutput) {
+            builder.setPositionOutput(&positions);
+        }
+        timerInternal = builder.build(keys, f);
+    } else {
+        MPHFbuilder builder(conf);
+        if (positionOutput) {
+            builder.setPositionOutput(&positions);
+        }
+        builder.setTransferChunkSize(transferChunkSize);
+        builder.setDeviceHashing(deviceHashing);
+        Trace trace;
+        if (!traceFile.empty()) {
+            builder.setTrace(&trace);
+        }
+        timerInternal = builder.build(keys, f);
+        if (!traceFile.empty()) {
+            trace.writeJson(traceFile);
+        }
+    }
     timerConstruct.addLabel("total_construct");
 
     if (validate) {
         // check valid
-        std::vector<bool> taken(keys.size(), false);
+        std::vector<bool> taken(f.range(), false);
         for (size_t i = 0; i < keys.size(); i++) {
             size_t hash = f(keys.at(i));
-            if (hash >= keys.size()) {
+            if (hash >= f.range()) {
                 std::cerr << "Out of range!" << std::endl;
                 return 1;
             }
@@ -57,12 +106,81 @@ bool benchmark(const std::vector<keytype> &keys) {
             }
             taken[hash] = true;
         }
+        // the SIMD queries keep pointers into the pilots, which have to follow a copied or moved function
+        MPHF<pilotencoder, offsetencoder, hashfunction> copied;
+        copied = f;
+        if (!batchMatches(copied, f, keys)) {
+            std::cerr << "Batched queries of a copied function differ!" << std::endl;
+            return false;
+        }
+        MPHF<pilotencoder, offsetencoder, hashfunction> moved;
+        moved = std::move(copied);
+        if (!batchMatches(moved, f, keys)) {
+            std::cerr << "Batched queries of a moved function differ!" << std::endl;
+            return false;
+        }
+        // a stored function loads again, a partition that does not fit its partition size is rejected
+        std::string file = (std::filesystem::temp_directory_path() / "phobic_gpu_validate.bin").string();
+        save(f, file);
+        MPHF<pilotencoder, offsetencoder, hashfunction> loaded;
+        load(loaded, file);
+        if (!batchMatches(loaded, f, keys)) {
+            std::cerr << "Loaded function differs!" << std::endl;
+            return false;
+        }
+        std::vector<char> stored;
+        {
+            std::ifstream in(file, std::ios::binary);
+            stored.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        // the partition size follows the magic, the version, the aligned type tag and the number of partitions
+        uint32_t corruptPartitionSize = 0;
+        std::memcpy(stored.data() + 24 + loaded.name().size() + sizeof(uint32_t), &corruptPartitionSize,
+                    sizeof(corruptPartitionSize));
+        std::remove(file.c_str());
+        try {
+            load(loaded, stored.data(), stored.size(), false);
+            std::cerr << "Loaded a corrupted function!" << std::endl;
+            return false;
+        } catch (const std::runtime_error &) {
+        }
+        // an empty key set builds an empty function without recording device commands
+        MPHF<pilotencoder, offsetencoder, hashfunction> empty;
+        std::vector<keytype> noKeys;
+        if (cpuBuild) {
+            CPUMPHFbuilder(conf).build(noKeys, empty);
+        } else {
+            MPHFbuilder(conf).build(noKeys, empty);
+        }
+        if (empty.size() != 0 || empty.range() != 0) {
+            std::cerr << "Empty key set built a non-empty function!" << std::endl;
+            return false;
+        }
         // result is valid
         std::cout << "Valid result" << std::endl;
     }
 
+    std::string positionsResult;
+    if (positionOutput) {
+        // the host pass that the position output replaces
+        HostTimer timerPositions;
+        std::vector<uint32_t> hostPositions(keys.size());
+#pragma omp parallel for
+        for (size_t i = 0; i < keys.size(); i++) {
+            hostPositions[i] = f(keys[i]);
+        }
+        timerPositions.addLabel("host_positions");
+        if (hostPositions != positions) {
+            std::cerr << "Build positions differ from the host!" << std::endl;
+            return false;
+        }
+        positionsResult = timerPositions.getResultStyle(size);
+    }
+
     const std::string querytimeKey = "query_time";
     std::string benchResult = querytimeKey + "=--- ";
+    int64_t queryTlbMisses = -1;
+    int64_t batchTlbMisses = -1;
     if (queries > 0) {
         // bench
         std::vector<keytype> queryInputs;
@@ -72,22 +190,60 @@ bool benchmark(const std::vector<keytype> &keys) {
             queryInputs.push_back(keys[pos]);
         }
 
+        std::vector<uint32_t> queryOutputs(queries);
+
+        TlbCounter tlbCounter;
         HostTimer timerQuery;
+        tlbCounter.start();
         for (int i = 0; i < queries; ++i) { DO_NOT_OPTIMIZE(f(queryInputs[i])); }
+        queryTlbMisses = tlbCounter.stop();
         timerQuery.addLabel(querytimeKey);
+        tlbCounter.start();
+        f.lookup_batch(queryInputs.data(), queries, queryOutputs.data());
+        DO_NOT_OPTIMIZE(queryOutputs.data());
+        batchTlbMisses = tlbCounter.stop();
+        timerQuery.addLabel("query_batch_time");
+
+        if (deviceQuery) {
+            std::vector<Key> queryKeys(queries);
+            f.initialHashBatch(queryInputs.data(), queries, queryKeys.data());
+            DeviceMPHF deviceF(f);
+            timerQuery.addLabel("device_query_setup");
+            std::vector<uint32_t> deviceOutputs;
+            deviceF.query(queryKeys, deviceOutputs);
+            timerQuery.addLabel("device_query_time");
+            deviceF.destroy();
+            if (deviceOutputs != queryOutputs) {
+                std::cerr << "Device queries differ from the host!" << std::endl;
+                return false;
+            }
+        }
+        for (int i = 0; i < queries; ++i) {
+            if (queryOutputs[i] != f(queryInputs[i])) {
+                std::cerr << "Batched queries differ from operator()!" << std::endl;
+                return false;
+            }
+        }
         benchResult = timerQuery.getResultStyle(queries);
     }
 
     std::cout << "RESULT " << f.getResultLine() << " " << benchResult
               << timerConstruct.getResultStyle(size) << " "
-              << timerInternal.getResultStyle(size) << "size=" << size << " queries=" << queries
+              << timerInternal.getResultStyle(size) << positionsResult << "size=" << size << " queries=" << queries
               << " l=" << lambda << " partition_size=" << partitionSize
               << " pilotencoder=" << f.getPilotEncoder().name()
               << " partitionencoder=" << offsetencoder::name()
               << " hashfunction=" << hashfunctionstring
               << " validated=" << validate
-              << " buckets_per_partition=" << conf.bucketCountPerPartition << " "
-              << App::getInstance().getInfoResultStyle() << std::endl;
+              << " buckets_per_partition=" << conf.bucketCountPerPartition
+              << " load_factor=" << loadFactor
+              << " remapped=" << conf.remapped()
+              << " cpu_build=" << cpuBuild
+              << " device_hash=" << deviceHashing
+              << " huge_pages=" << !noHugePages
+              << " query_dtlb_misses=" << queryTlbMisses
+              << " query_batch_dtlb_misses=" << batchTlbMisses << " "
+              << (cpuBuild ? "" : App::getInstance().getInfoResultStyle()) << std::endl;
     return true;
 }
 
@@ -208,6 +364,11 @@ bool dispatchPilotEncoderStrat() {
         if (pilotencoderstrat == "inter") {
             return dispatchEncoderBase<interleaved_encoder<pilotbaseencoder>>(partitionencoderbase);
         }
+        if constexpr (flat_column<pilotbaseencoder>::supported) {
+            if (pilotencoderstrat == "flatinter") {
+                return dispatchEncoderBase<flat_interleaved_encoder<pilotbaseencoder>>(partitionencoderbase);
+            }
+        }
     }
     if (pilotencoderstrat == "dualinter") {
         return dispatchEncoderBase<interleaved_encoder_dual<rice, compact>>(partitionencoderbase);
@@ -230,6 +391,7 @@ bool dispatchEncoderBase(std::string basestring) {
     if (basestring == "ef") { return dispatchDynamic<pilotencoderstrat, elias_fano>(); }
     if (basestring == "d") { return dispatchDynamic<pilotencoderstrat, dictionary>(); }
     if (basestring == "r") { return dispatchDynamic<pilotencoderstrat, rice>(); }
+    if (basestring == "br") { return dispatchDynamic<pilotencoderstrat, blocked_rice>(); }
     if (basestring == "sdc") { return dispatchDynamic<pilotencoderstrat, sdc>(); }
     // workaround for dual
     if constexpr (std::is_same<pilotencoderstrat, void>::value) {
@@ -239,7 +401,6 @@ bool dispatchEncoderBase(std::string basestring) {
 }
 
 int main(int argc, char *argv[]) {
-    App::getInstance().printDebugInfo();
     tlx::CmdlineParser cmd;
     uint64_t threads = 8;
     cmd.add_bytes('n', "size", size, "Number of objects to construct with");
@@ -261,10 +422,28 @@ int main(int argc, char *argv[]) {
                    "The type of the input keys");
     cmd.add_bool('v', "validate", validate, "Wether the MPHF is validated");
     cmd.add_bytes('t', "threads", threads, "omp_set_num_threads(t)");
+    cmd.add_bool('c', "cpu", cpuBuild, "Build on the CPU instead of the GPU");
+    cmd.add_bytes('u', "transferchunk", transferChunkSize,
+                  "Keys per upload chunk with early offset encoding or 0 for 8 MiB chunks");
+    cmd.add_bool('g', "devicehash", deviceHashing, "Compute the initial xxhash of the keys on the GPU");
+    cmd.add_string('j', "trace", traceFile, "Write a Chrome trace of the GPU build to this JSON file");
+    cmd.add_bool('H', "nohugepages", noHugePages, "Keep the encoders and build buffers on 4 KB pages");
+    cmd.add_bool('x', "devicequery", deviceQuery,
+                 "Also evaluate the queries on the GPU, including the transfers, and compare with the host");
+    cmd.add_bool('P', "positions", positionOutput,
+                 "Output f(key) of all keys during the build and compare with evaluating them on the host");
+    cmd.add_double('a', "loadfactor", loadFactor,
+                   "Fraction of the positions of a partition filled by its keys, between 0.5 and 1");
+    cmd.add_bool('N', "noremap", noRemap,
+                 "With a load factor below 1, keep the function non-minimal instead of remapping the positions");
 
     bool valid = cmd.process(argc, argv);
     if(valid) {
+        if (!cpuBuild || deviceQuery) {
+            App::getInstance().printDebugInfo();
+        }
         omp_set_num_threads(threads);
+        huge_pages_enabled() = !noHugePages;
         valid = dispatchEncoderBase<void>(pilotencoderbase);
     }
     if (!valid) {
@@ -0,0 +1,39 @@
+# Writes OUTPUT, a source file that holds the SPIR-V binaries listed in SHADERS (separated by commas)
+# and defines findEmbeddedShader() over them. Run with cmake -P.
+string(REPLACE "," ";" SHADERS "${SHADERS}")
+
+# cmake regular expressions have no repetition counts
+string(REPEAT "0x[0-9a-f][0-9a-f]," 16 line)
+
+set(arrays "")
+set(table "")
+foreach (spv ${SHADERS})
+    get_filename_component(name ${spv} NAME)
+    string(REPLACE ".comp.spv" "" name ${name})
+    file(READ ${spv} hex HEX)
+    # 16 bytes per line
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+    string(REGEX REPLACE "(${line})" "\\1\n        " bytes "${bytes}")
+    string(APPEND arrays "alignas(4) static const unsigned char spirv_${name}[] = {\n        ${bytes}\n};\n\n")
+    string(APPEND table "        {\"${name}\", spirv_${name}, sizeof(spirv_${name})},\n")
+endforeach ()
+
+file(WRITE ${OUTPUT}.tmp
+        "// generated by cmake/embed_shaders.cmake\n"
+        "#include \"app/embedded_shaders.h\"\n\n"
+        "#include <cstring>\n\n"
+        "${arrays}"
+        "static const EmbeddedShader EMBEDDED_SHADERS[] = {\n"
+        "${table}"
+        "};\n\n"
+        "const EmbeddedShader *findEmbeddedShader(const char *name) {\n"
+        "    for (const EmbeddedShader &shader: EMBEDDED_SHADERS) {\n"
+        "        if (std::strcmp(shader.name, name) == 0) {\n"
+        "            return &shader;\n"
+        "        }\n"
+        "    }\n"
+        "    return nullptr;\n"
+        "}\n")
+# keep the timestamp if nothing changed, such that the library is not rebuilt
+configure_file(${OUTPUT}.tmp ${OUTPUT} COPYONLY)
+file(REMOVE ${OUTPUT}.tmp)
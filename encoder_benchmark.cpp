@@ -0,0 +1,250 @@
+#include <chrono>
+#include <tlx/cmdline_parser.hpp>
+
+#include <phobic_gpu_mphf.hpp>
+#include <app/tlb_counter.h>
+#include <omp.h>
+#include <algorithm>
+#include <vector>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <cstdint>
+
+using namespace phobicgpu;
+
+#define DO_NOT_OPTIMIZE(value) asm volatile("" : : "r,m"(value) : "memory")
+
+size_t size = 1e7;
+size_t queries = 1e7;
+double lambda = 7.5;
+double tradeoff = 0.5;
+size_t partitionSize = 2048;
+size_t rounds = 3;
+std::string pilotencoderstrat = "all";
+std::string pilotencoderbase = "all";
+bool gpuBuild = false;
+bool noHugePages = false;
+
+std::vector<uint32_t> pilots;
+uint64_t partitions;
+uint64_t buckets;
+std::vector<std::pair<uint32_t, uint32_t>> randomQueries;
+
+// the pilots of a real build over uniformly random keys, stored bucket-major like MPHF::setData receives them
+void buildPilots() {
+    std::mt19937_64 prng(42);
+    std::vector<Key> keys(size);
+    for (Key &key: keys) {
+        uint64_t upper = prng();
+        uint64_t lower = prng();
+        key = Key(uint32_t(upper >> 32), uint32_t(upper), uint32_t(lower >> 32), uint32_t(lower));
+    }
+
+    MPHFconfig conf(lambda, partitionSize);
+    SuperBatchResult result;
+    auto begin = std::chrono::high_resolution_clock::now();
+    if (gpuBuild) {
+        App::getInstance().printDebugInfo();
+        MPHFbuilder builder(conf);
+        builder.build(keys, result);
+    } else {
+        CPUMPHFbuilder builder(conf);
+        builder.build(keys, result);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "built pilots of " << size << " keys in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "ms" << std::endl;
+
+    pilots.swap(result.pilots);
+    buckets = conf.bucketCountPerPartition;
+    partitions = pilots.size() / buckets;
+
+    randomQueries.resize(queries);
+    std::uniform_int_distribution<uint32_t> partitionDis(0, partitions - 1);
+    std::uniform_int_distribution<uint32_t> bucketDis(0, buckets - 1);
+    for (auto &query: randomQueries) {
+        query = {partitionDis(prng), bucketDis(prng)};
+    }
+}
+
+// best of rounds in seconds
+template<typename F>
+double measure(F &&run) {
+    double best = std::numeric_limits<double>::max();
+    for (size_t round = 0; round < rounds; round++) {
+        auto begin = std::chrono::high_resolution_clock::now();
+        run();
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - begin).count());
+    }
+    return best;
+}
+
+template<typename pilotencoder>
+struct isDual : std::false_type {};
+
+template<typename first, typename second>
+struct isDual<interleaved_encoder_dual<first, second>> : std::true_type {};
+
+template<typename pilotencoder>
+bool benchmark() {
+    pilotencoder encoder;
+    auto encode = [&] {
+        encoder = pilotencoder();
+        if constexpr (isDual<pilotencoder>::value) {
+            encoder.setEncoderTradeoff(tradeoff);
+        }
+        encoder.encode(pilots.begin(), partitions, buckets);
+    };
+    double encodeTime = measure(encode);
+
+    for (uint64_t bucket = 0; bucket < buckets; bucket++) {
+        for (uint64_t partition = 0; partition < partitions; partition++) {
+            if (encoder.access(partition, bucket) != pilots[bucket * partitions + partition]) {
+                std::cerr << encoder.name() << " decodes a wrong pilot at partition " << partition
+                          << " and bucket " << bucket << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // sequential in the order of the pilot array, which is the storage order of mono_encoder
+    double sequentialTime = measure([&] {
+        uint64_t sum = 0;
+        for (uint64_t bucket = 0; bucket < buckets; bucket++) {
+            for (uint64_t partition = 0; partition < partitions; partition++) {
+                sum += encoder.access(partition, bucket);
+            }
+        }
+        DO_NOT_OPTIMIZE(sum);
+    });
+    TlbCounter tlbCounter;
+    int64_t randomTlbMisses = -1;
+    double randomTime = measure([&] {
+        tlbCounter.start();
+        uint64_t sum = 0;
+        for (auto [partition, bucket]: randomQueries) {
+            sum += encoder.access(partition, bucket);
+        }
+        DO_NOT_OPTIMIZE(sum);
+        randomTlbMisses = tlbCounter.stop();
+    });
+
+    // every access depends on the previous one, pilots never have the top bit set. The value is hidden from the
+    // compiler, which could otherwise derive this from the decoding and drop the dependency.
+    double dependentTime = measure([&] {
+        uint64_t value = 0;
+        for (auto [partition, bucket]: randomQueries) {
+            asm volatile("" : "+r"(value));
+            value = encoder.access(partition + (value >> 63), bucket);
+        }
+        DO_NOT_OPTIMIZE(value);
+    });
+
+    std::cout << "RESULT encoder=" << encoder.name()
+              << " size=" << size
+              << " values=" << pilots.size()
+              << " lambda=" << lambda
+              << " partitionsize=" << partitionSize
+              << " threads=" << omp_get_max_threads()
+              << " bits_per_value=" << double(encoder.num_bits()) / double(pilots.size())
+              << " bits_per_key=" << double(encoder.num_bits()) / double(size)
+              << " encode_values_per_second=" << double(pilots.size()) / encodeTime
+              << " sequential_access_ns=" << sequentialTime * 1e9 / double(pilots.size())
+              << " random_access_ns=" << (queries == 0 ? 0.0 : randomTime * 1e9 / double(queries))
+              << " dependent_access_ns=" << (queries == 0 ? 0.0 : dependentTime * 1e9 / double(queries))
+              << " huge_pages=" << !noHugePages
+              << " random_access_dtlb_misses=" << randomTlbMisses
+              << std::endl;
+    return true;
+}
+
+template<typename base>
+bool dispatchPilotEncoderStrat() {
+    bool all = pilotencoderstrat == "all";
+    bool valid = false;
+    if (all || pilotencoderstrat == "mono") {
+        valid = benchmark<mono_encoder<base>>();
+        if (!valid) return false;
+    }
+    if (all || pilotencoderstrat == "inter") {
+        valid = benchmark<interleaved_encoder<base>>();
+        if (!valid) return false;
+    }
+    if constexpr (flat_column<base>::supported) {
+        if (all || pilotencoderstrat == "flatinter") {
+            valid = benchmark<flat_interleaved_encoder<base>>();
+            if (!valid) return false;
+        }
+    }
+    if (all || pilotencoderstrat == "dualinter") {
+        valid = benchmark<interleaved_encoder_dual<base, compact>>();
+        if (!valid) return false;
+    }
+    return valid;
+}
+
+bool dispatchEncoderBase() {
+    bool all = pilotencoderbase == "all";
+    bool valid = false;
+    if (all || pilotencoderbase == "c") {
+        valid = dispatchPilotEncoderStrat<compact>();
+        if (!valid) return false;
+    }
+    if (all || pilotencoderbase == "pc") {
+        valid = dispatchPilotEncoderStrat<partitioned_compact>();
+        if (!valid) return false;
+    }
+    if (all || pilotencoderbase == "r") {
+        valid = dispatchPilotEncoderStrat<rice>();
+        if (!valid) return false;
+    }
+    if (all || pilotencoderbase == "br") {
+        valid = dispatchPilotEncoderStrat<blocked_rice>();
+        if (!valid) return false;
+    }
+    if (all || pilotencoderbase == "ef") {
+        valid = dispatchPilotEncoderStrat<elias_fano>();
+        if (!valid) return false;
+    }
+    if (all || pilotencoderbase == "d") {
+        valid = dispatchPilotEncoderStrat<dictionary>();
+        if (!valid) return false;
+    }
+    if (all || pilotencoderbase == "sdc") {
+        valid = dispatchPilotEncoderStrat<sdc>();
+        if (!valid) return false;
+    }
+    return valid;
+}
+
+int main(int argc, char *argv[]) {
+    tlx::CmdlineParser cmd;
+    uint64_t threads = 1;
+    cmd.add_bytes('n', "size", size, "Number of keys of the build that yields the pilots");
+    cmd.add_bytes('q', "queries", queries, "Number of random accesses");
+    cmd.add_double('l', "lambda", lambda, "Average number of elements in one bucket");
+    cmd.add_bytes('p', "partitionsize", partitionSize, "Expected size of the partitions");
+    cmd.add_string('e', "pilotencoderstrat", pilotencoderstrat, "The pilot encoding strategy or all");
+    cmd.add_string('b', "pilotencoderbase", pilotencoderbase, "The pilot encoding technique or all");
+    cmd.add_double('d', "dualtradeoff", tradeoff,
+                   "relative number of buckets in the first encoder (only for dual)");
+    cmd.add_bytes('r', "rounds", rounds, "Repetitions per measurement, the fastest is reported");
+    cmd.add_bytes('t', "threads", threads, "omp_set_num_threads(t), used by the interleaved encoders");
+    cmd.add_bool('g', "gpu", gpuBuild, "Build the pilots on the GPU instead of the CPU");
+    cmd.add_bool('H', "nohugepages", noHugePages, "Keep the encoders on 4 KB pages");
+
+    bool valid = cmd.process(argc, argv) && rounds > 0;
+    if (valid) {
+        omp_set_num_threads(threads);
+        huge_pages_enabled() = !noHugePages;
+        buildPilots();
+        valid = dispatchEncoderBase();
+    }
+    if (!valid) {
+        cmd.print_usage();
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#include <chrono>
+#include <tlx/cmdline_parser.hpp>
+
+#include <phobic_gpu_mphf.hpp>
+#include <algorithm>
+#include <vector>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <cstdint>
+#include <cstring>
+
+using namespace phobicgpu;
+
+#define DO_NOT_OPTIMIZE(value) asm volatile("" : : "r,m"(value) : "memory")
+
+size_t size = 1e7;
+size_t minLength = 8;
+size_t maxLength = 64;
+size_t lengthStep = 4;
+size_t rounds = 3;
+
+std::vector<std::string> generateStrings(size_t n, size_t length) {
+    std::mt19937_64 prng(length);
+    std::vector<std::string> strings(n, std::string(length, ' '));
+    for (std::string &string: strings) {
+        for (char &c: string) {
+            c = char(1 + prng() % 255);
+        }
+    }
+    return strings;
+}
+
+// best of rounds in seconds
+template<typename F>
+double measure(F &&hashAll) {
+    double best = std::numeric_limits<double>::max();
+    for (size_t round = 0; round < rounds; round++) {
+        auto begin = std::chrono::high_resolution_clock::now();
+        hashAll();
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - begin).count());
+    }
+    return best;
+}
+
+void printResult(const char *method, size_t length, double seconds) {
+    std::cout << "RESULT method=" << method
+              << " length=" << length
+              << " size=" << size
+              << " keys_per_second=" << size / seconds
+              << " gb_per_second=" << double(size) * length / seconds / 1e9 << std::endl;
+}
+
+bool benchmarkLength(size_t length) {
+    std::vector<std::string> strings = generateStrings(size, length);
+    std::vector<Key> scalar(size);
+    std::vector<Key> batched(size);
+
+    double scalarTime = measure([&] {
+        for (size_t i = 0; i < size; i++) {
+            scalar[i] = xxhash::hash(strings[i]);
+        }
+        DO_NOT_OPTIMIZE(scalar.data());
+    });
+    double batchTime = measure([&] {
+        for (size_t i = 0; i < size; i += HASH_BATCH_SIZE) {
+            xxhash::hash_batch(strings.data() + i, std::min(HASH_BATCH_SIZE, size - i), batched.data() + i);
+        }
+        DO_NOT_OPTIMIZE(batched.data());
+    });
+
+    for (size_t i = 0; i < size; i++) {
+        if (std::memcmp(&scalar[i], &batched[i], sizeof(Key)) != 0) {
+            std::cerr << "batched hash differs for key " << i << " of length " << length << std::endl;
+            return false;
+        }
+    }
+    printResult("scalar", length, scalarTime);
+    printResult("batch", length, batchTime);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    tlx::CmdlineParser cmd;
+    cmd.add_bytes('n', "size", size, "Number of keys per length");
+    cmd.add_bytes('a', "minlength", minLength, "Shortest key length in bytes");
+    cmd.add_bytes('b', "maxlength", maxLength, "Longest key length in bytes");
+    cmd.add_bytes('s', "step", lengthStep, "Step between key lengths");
+    cmd.add_bytes('r', "rounds", rounds, "Repetitions per measurement, the fastest is reported");
+
+    if (!cmd.process(argc, argv) || lengthStep == 0 || rounds == 0) {
+        cmd.print_usage();
+        return EXIT_FAILURE;
+    }
+    for (size_t length = minLength; length <= maxLength; length += lengthStep) {
+        if (!benchmarkLength(length)) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <string>
 #include <vector>
 #include <optional>
 
@@ -10,6 +11,7 @@
 #include "memory.h"
 #include "pipeline.h"
 #include "command_buffer.h"
+#include "trace.h"
 
 
 
@@ -54,9 +56,17 @@ private:
     QueueFamilyIndices indices;
     std::vector<Shader *> loadedShaders;
     std::vector<ShaderStage *> stages;
+    std::string pipelineCachePath;
+    PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps = nullptr;
     App();
 public:
     uint32_t subGroupSize;
+    // 64-bit integer arithmetic in shaders
+    bool shaderInt64;
+    // VK_EXT_calibrated_timestamps relates device timestamps to CLOCK_MONOTONIC
+    bool calibratedTimestamps;
+    // the transfer queue writes timestamps into query pools that the host resets
+    bool transferTimestamps;
 
     vk::Instance instance;
 
@@ -68,6 +78,9 @@ public:
     vk::CommandPool transferCommandPool;
     vk::CommandPool computeCommandPool;
 
+    // loaded from pipelineCachePath on creation and stored there again on destruction
+    vk::PipelineCache pipelineCache;
+
     MemoryAllocator memoryAlloc;
     DescriptorAllocator descrAlloc;
 
@@ -84,6 +97,10 @@ public:
 
     CommandBuffer *createCommandBuffer();
 
+    // A device timestamp and the host time of Trace::now() at the same moment. Without calibrated timestamps,
+    // the host time halfway through the round trip of a submitted timestamp is used.
+    TimestampCalibration calibrateTimestamps();
+
     const Shader *loadShader(const char *shaderPath);
 
     const ShaderStage *computeStage(
@@ -16,7 +16,10 @@ struct TimestampHandle {
 
 struct TimestampResult {
     TimestampHandle handle;
+    // nanoseconds since the first timestamp
     float time;
+    // raw device timestamp, see App::calibrateTimestamps()
+    uint64_t ticks;
 };
 
 class TimestampCreateInfo {
@@ -40,6 +43,12 @@ private:
     TimestampCreateInfo timestampsInfo;
     std::vector<TimestampResult> lastRead;
 
+    // fence of a submission that was not waited for
+    vk::Fence pendingFence;
+
+    // commands are recorded and not ended yet
+    bool recording = false;
+
 public:
     DescriptorAllocator descrAlloc;
 
@@ -69,6 +78,12 @@ public:
 
     void readWritePipelineBarrier();
 
+    // makes the writes of fillBuffer and copyBuffer visible to the reads and atomics of later compute shaders
+    void transferComputeBarrier();
+
+    // makes transfer writes visible to host reads, e.g., of a buffer that the host reads after the fence
+    void transferHostBarrier();
+
     void bindComputePipeline(const vk::Pipeline &computePipeline);
 
     void bindComputePipeline(const Pipeline &computePipeline);
@@ -77,9 +92,13 @@ public:
 
     void submit(const vk::Device &device, const vk::Queue &queue, const bool wait = false);
 
+    // waits for a submission with wait = false
+    void wait(const vk::Device &device);
+
     void destroy(const vk::Device &device, const vk::CommandPool &commandPool);
 
-    void begin();
+    // a reusable buffer can be submitted again after its submission completed
+    void begin(bool reusable = false);
 
     void attachTimestamps(const vk::Device &device, TimestampCreateInfo createInfo);
 
@@ -89,5 +108,8 @@ public:
 
     std::vector<TimestampResult> getTimestamps();
 
-    void copyBuffer(vk::Buffer src, vk::Buffer dst, vk::DeviceSize byteSize);
+    void copyBuffer(vk::Buffer src, vk::Buffer dst, vk::DeviceSize byteSize, vk::DeviceSize srcOffset = 0,
+                    vk::DeviceSize dstOffset = 0);
+
+    void fillBuffer(vk::Buffer dst, vk::DeviceSize byteSize, uint32_t value);
 };
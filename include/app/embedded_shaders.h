@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+// SPIR-V of a shader compiled into the library by cmake/embed_shaders.cmake
+struct EmbeddedShader {
+    const char *name;
+    const unsigned char *code;
+    size_t size;
+};
+
+// the shader shaders/<name>.comp or nullptr if it was not embedded
+const EmbeddedShader *findEmbeddedShader(const char *name);
@@ -1,28 +1,47 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+class Trace;
+
 class HostTimer {
     struct Label {
         double time;
         std::string name;
     };
 private:
-    using clock = std::chrono::high_resolution_clock;
+    // the clock of Trace::now()
+    using clock = std::chrono::steady_clock;
     std::vector<Label> labels;
+    std::vector<Label> measurements;
     clock::time_point start;
+    Trace *trace = nullptr;
+    // time of the last label added by addLabel
+    double lastLabel = 0;
+
+    uint64_t traceTime(double time) const;
 
 public:
     HostTimer();
 
     void reset();
 
+    // labels added afterwards also end a host phase in trace, which starts at the previous label
+    void attachTrace(Trace *trace);
+
     void addLabel(std::string name);
 
     void addLabelManually(std::string name, double time);
 
+    // durations that are not part of the timeline, e.g., work that was hidden behind other work
+    void addMeasurement(std::string name, double time);
+
+    // an interval of elapsed() times that only appears in the attached trace
+    void addSpan(std::string name, double begin, double end);
+
     std::string getResultStyle(double div) const;
 
     void printLabels(double div) const;
@@ -1,17 +1,58 @@
 #pragma once
 
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "vulkan_api.h"
 #include "queue_family.h"
+#include "trace.h"
 
 class MemoryAllocator;
 
+//
+// A large device memory allocation that is handed out in aligned ranges.
+// Host visible blocks stay mapped for their whole lifetime.
+//
+class MemoryBlock {
+public:
+    vk::DeviceMemory memory;
+    vk::DeviceSize size;
+    uint32_t memoryTypeIndex;
+    void *mapped;
+
+private:
+    // offset -> size of the unused ranges, adjacent ranges are merged on release
+    std::map<vk::DeviceSize, vk::DeviceSize> freeRanges;
+
+public:
+    MemoryBlock(vk::DeviceMemory memory, vk::DeviceSize size, uint32_t memoryTypeIndex, void *mapped);
+
+    // returns the offset of the range or size if there is no suitable range
+    vk::DeviceSize alloc(vk::DeviceSize len, vk::DeviceSize alignment);
+
+    void release(vk::DeviceSize offset, vk::DeviceSize len);
+
+    bool empty() const;
+};
+
 class MemoryAllocation {
 public:
     vk::DeviceSize offset;
     vk::DeviceSize capacity;
     vk::DeviceMemory memory;
 
+    // points to offset if the memory is host visible
+    void *mapped = nullptr;
+    // properties of the memory type
+    vk::MemoryPropertyFlags memoryFlags;
+
+    // the block this allocation was carved from or nullptr if the memory is dedicated to it
+    MemoryBlock *block = nullptr;
+    // size of the range in the block, at least capacity
+    vk::DeviceSize blockRange = 0;
+
     MemoryAllocation() : offset(0), capacity(0) {};
 
     MemoryAllocation(
@@ -51,17 +92,54 @@ public:
 
     bool isReady() const;
 
+    // blocks until the copy has finished and releases it, does nothing if no copy is pending
+    void wait();
+
     void complete();
 
     void release();
 };
 
+//
+// One of the persistently mapped staging buffers that MemoryAllocator uses in turns.
+// Its command buffer and fence are reused for every transfer.
+//
+struct StagingSlot {
+    BufferAllocation buffer;
+    vk::CommandBuffer commands;
+    vk::Fence fence;
+    bool pending = false;
+    // download slots may be host cached without being coherent, see MemoryAllocator::download
+    bool coherent = true;
+
+    // begin and end of the pending transfer if it is traced
+    vk::QueryPool timestamps;
+    bool timed = false;
+    const char *transfer = nullptr;
+    size_t bytes = 0;
+};
+
 class MemoryAllocator {
 private:
+    // state that is shared by all copies of the allocator
+    struct Pools {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<MemoryBlock>> blocks;
+        std::vector<StagingSlot> stagingRing;
+        size_t nextStagingSlot = 0;
+        // the host reads downloads, which is slow from the write-combined memory of the upload slots
+        std::vector<StagingSlot> downloadRing;
+        size_t nextDownloadSlot = 0;
+        Trace *trace = nullptr;
+        TimestampCalibration calibration;
+    };
+
     vk::Queue transferQueue;
     vk::CommandPool transferCommandPool;
     vk::PhysicalDeviceMemoryProperties deviceProperties;
+    vk::DeviceSize nonCoherentAtomSize = 1;
     QueueFamilyIndices queueIndices;
+    std::shared_ptr<Pools> pools;
 public:
     vk::Device device;
     vk::PhysicalDevice pDevice;
@@ -91,15 +169,20 @@ private:
             const vk::MemoryRequirements &memRequirements,
             const vk::MemoryPropertyFlags flags) const;
 
-    vk::DeviceMemory allocateBufferMemory(
-            const vk::Buffer &buffer,
+    // binds the buffer to a range of a memory block or to dedicated memory for large buffers
+    void bindBufferMemory(
+            BufferAllocation &allocation,
             const vk::MemoryPropertyFlags flags) const;
 
+    // host cached memory for the staging slots of downloads, coherent if available
+    vk::MemoryPropertyFlags downloadStagingFlags() const;
+
 public:
     //
     // Creates a new exclusive buffer and allocates memory  for it
     // usually createStagingBuffer() or createDeviceLocalBuffer() should be
-    // used instead.
+    // used instead. Small buffers share large memory blocks instead of
+    // allocating memory individually.
     // @see BufferAllocation#free()
     //
     BufferAllocation createBuffer(
@@ -152,4 +235,68 @@ public:
     void runTransferCommandsSync(std::function<void(const vk::CommandBuffer &)> recorder) const;
 
     AsyncCopyOp runTransferCommandsAsync(std::function<void(const vk::CommandBuffer &)> recorder) const;
+
+    //
+    // Returns the next slot of the staging ring with room for at least capacity bytes.
+    // Waits until the previous transfer of the slot has finished. Slots for downloads come from a
+    // separate ring of host cached memory.
+    //
+    StagingSlot &acquireStaging(const size_t capacity, const bool download = false) const;
+
+    //
+    // Submits a copy between the staging slot and the buffer on the transfer queue
+    // without waiting for it.
+    //
+    void submitStagingUpload(
+            StagingSlot &slot,
+            const BufferAllocation &dst,
+            const size_t len,
+            const vk::DeviceSize dstOffset = 0) const;
+
+    void submitStagingDownload(
+            StagingSlot &slot,
+            const BufferAllocation &src,
+            const size_t len,
+            const vk::DeviceSize srcOffset = 0) const;
+
+    void waitStaging(StagingSlot &slot) const;
+
+    //
+    // Makes a completed download visible to the host if the memory of the slot is not coherent.
+    //
+    void invalidateStaging(const StagingSlot &slot) const;
+
+    void waitAllStaging() const;
+
+    //
+    // Records the staging transfers that are submitted afterwards into trace, nullptr stops recording.
+    // Requires timestamps on the transfer queue that the host can reset, see App::transferTimestamps.
+    //
+    void traceTransfers(Trace *trace, const TimestampCalibration &calibration) const;
+
+    //
+    // Returns the memory of a freed buffer to its block or frees dedicated memory.
+    //
+    void releaseMemory(const MemoryAllocation &allocation) const;
+
+    //
+    // Copies between host memory and a device local buffer through the staging ring.
+    // Large copies are split such that copying one part on the host overlaps the transfer of another.
+    //
+    void upload(
+            const BufferAllocation &dst,
+            const void *src,
+            const size_t len,
+            const vk::DeviceSize dstOffset = 0) const;
+
+    void download(
+            const BufferAllocation &src,
+            void *dst,
+            const size_t len,
+            const vk::DeviceSize srcOffset = 0) const;
+
+    //
+    // Releases the memory blocks and the staging ring, all buffers have to be freed before.
+    //
+    void destroy();
 };
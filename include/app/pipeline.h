@@ -28,6 +28,7 @@ protected:
     const Shader *shader;
     std::vector<vk::DescriptorSetLayout> descriptorSetLayouts;
     std::vector<vk::PushConstantRange> pushConstantRanges;
+    vk::PipelineCache pipelineCache;
 public:
     PipelineBuilder(const Shader *shader);
 
@@ -35,6 +36,9 @@ public:
 
     void addPushConstantRange(const vk::PushConstantRange &range);
 
+    // pipelines are looked up in and added to the cache
+    void setPipelineCache(const vk::PipelineCache &cache);
+
     virtual Pipeline build(const vk::Device &device) const = 0;
 };
 
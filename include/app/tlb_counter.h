@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Counts the data TLB misses of loads by the calling thread in user space with perf_event_open. Kernels that
+// do not permit the counter, e.g., with a restrictive perf_event_paranoid or without a virtualized PMU, leave it
+// unavailable and every measurement reports -1.
+class TlbCounter {
+private:
+    int fd = -1;
+
+public:
+    TlbCounter();
+
+    ~TlbCounter();
+
+    TlbCounter(const TlbCounter &) = delete;
+
+    TlbCounter &operator=(const TlbCounter &) = delete;
+
+    bool available() const;
+
+    void start();
+
+    // misses since start()
+    int64_t stop();
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Maps device timestamps to the host clock of Trace::now().
+struct TimestampCalibration {
+    uint64_t deviceTicks = 0;
+    uint64_t hostTime = 0;
+    // nanoseconds per device tick
+    double period = 1;
+
+    uint64_t toHost(uint64_t ticks) const {
+        return hostTime + int64_t(double(int64_t(ticks - deviceTicks)) * period);
+    }
+};
+
+// Timeline of host phases, compute queue stages and transfers of one or more builds. All events are in
+// nanoseconds of the monotonic host clock, device timestamps are converted with a TimestampCalibration.
+// writeJson() produces the Chrome trace event format, which chrome://tracing and Perfetto display.
+class Trace {
+public:
+    enum Track : uint32_t {
+        eHost = 0,
+        eCompute = 1,
+        eTransfer = 2
+    };
+
+    struct Event {
+        Track track;
+        std::string name;
+        uint64_t begin;
+        uint64_t end;
+        std::vector<std::pair<std::string, double>> args;
+    };
+
+private:
+    mutable std::mutex mutex;
+    std::vector<Event> events;
+
+public:
+    // CLOCK_MONOTONIC in nanoseconds, the host time domain of VK_EXT_calibrated_timestamps
+    static uint64_t now();
+
+    // thread safe
+    void add(Track track, std::string name, uint64_t begin, uint64_t end,
+             std::vector<std::pair<std::string, double>> args = {});
+
+    std::vector<Event> getEvents() const;
+
+    void clear();
+
+    // timestamps are relative to the earliest event
+    void writeJson(const std::string &filename) const;
+};
@@ -67,6 +67,18 @@ void fillHostBuffer(vk::Device &device, vk::DeviceMemory &mem, std::vector<T> &p
     fillHostBuffer(device, mem, pilots.data(), pilots.size());
 }
 
+// reads a host visible buffer, which stays mapped for its whole lifetime
+template<typename T>
+void fillHostBuffer(const BufferAllocation &b, T *output, size_t size) {
+    CHECK(b.mapped != nullptr, "buffer is not host visible");
+    memcpy(output, b.mapped, size * sizeof(T));
+}
+
+template<typename T>
+void fillHostBuffer(const BufferAllocation &b, std::vector<T> &output) {
+    fillHostBuffer(b, output.data(), output.size());
+}
+
 template<typename T>
 void fillDeviceWithStagingBuffer(vk::PhysicalDevice &pDevice, vk::Device &device,
                                  vk::CommandPool &commandPool, vk::Queue &q,
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "util.hpp"
+#include "mappable_vector.hpp"
 
 #include <essentials.hpp>
 
@@ -134,7 +135,7 @@ struct bit_vector_builder {
         std::swap(m_cur_word, other.m_cur_word);
     }
 
-    std::vector<uint64_t>& data() {
+    huge_page_vector<uint64_t>& data() {
         return m_bits;
     }
 
@@ -143,7 +144,7 @@ struct bit_vector_builder {
     }
 
 private:
-    std::vector<uint64_t> m_bits;
+    huge_page_vector<uint64_t> m_bits;
     uint64_t m_size;
     uint64_t* m_cur_word = nullptr;
 };
@@ -153,7 +154,7 @@ struct bit_vector {
 
     void build(bit_vector_builder* in) {
         m_size = in->size();
-        m_bits.swap(in->data());
+        m_bits = std::move(in->data());
     }
 
     bit_vector(bit_vector_builder* in) {
@@ -225,7 +226,7 @@ struct bit_vector {
         return block * 64 + ret;
     }
 
-    std::vector<uint64_t> const& data() const {
+    mappable_vector<uint64_t> const& data() const {
         return m_bits;
     }
 
@@ -304,7 +305,7 @@ struct bit_vector {
 
 protected:
     size_t m_size;
-    std::vector<uint64_t> m_bits;
+    mappable_vector<uint64_t> m_bits;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "fastmod/fastmod.h"
+
+#include "compact_vector.hpp"
+#include "mappable_vector.hpp"
+#include "util.hpp"
+
+namespace phobicgpu {
+
+    // Rice codes of a fixed number of values per cache line, such that access() touches one line. The first
+    // byte of a block holds its Rice parameter, followed by the unary high parts and the fixed width low
+    // parts at the end of the block. The rare blocks whose codes do not fit store their values in a
+    // compact_vector instead, the block then holds the index of the values there.
+    // The values per block are chosen for the whole sequence, so the space is close to rice_sequence
+    // if the values follow the same distribution everywhere, e.g., the pilots of one bucket in
+    // interleaved_encoder.
+    struct blocked_rice_sequence {
+        static constexpr uint64_t block_bits = 512;
+        static constexpr uint64_t header_bits = 8;
+        static constexpr uint64_t overflow = 0xFF;
+        // access() reads the low bits with one unaligned word
+        static constexpr uint64_t max_l = 56;
+        // values used to choose the values per block, taken from sample_runs places of the sequence
+        static constexpr uint64_t sample_size = 1 << 16;
+        static constexpr uint64_t sample_runs = 64;
+
+        template<typename Iterator>
+        void encode(Iterator begin, uint64_t n) {
+            m_size = n;
+            if (n == 0) return;
+
+            std::vector<uint64_t> values(begin, begin + n);
+            std::vector<uint64_t> sample;
+            if (n <= sample_size) {
+                sample = values;
+            } else {
+                uint64_t run = sample_size / sample_runs;
+                for (uint64_t r = 0; r < sample_runs; r++) {
+                    uint64_t first = r * (n - run) / (sample_runs - 1);
+                    sample.insert(sample.end(), values.begin() + first, values.begin() + first + run);
+                }
+            }
+            set_values_per_block(best_values_per_block(sample));
+
+            // the blocks are written in parallel, the overflowing ones are numbered afterwards
+            uint64_t num_blocks = (n + m_values_per_block - 1) / m_values_per_block;
+            huge_page_vector<util::cache_line> blocks(num_blocks);
+            std::vector<uint8_t> block_l(num_blocks);
+#pragma omp parallel for if(n >= 2 * sample_size)
+            for (uint64_t b = 0; b < num_blocks; b++) {
+                uint64_t first = b * m_values_per_block;
+                uint64_t count = std::min(m_values_per_block, n - first);
+                block_l[b] = best_l(values.data() + first, count, m_values_per_block);
+                if (block_l[b] != overflow) {
+                    write_block(blocks[b], values.data() + first, count, block_l[b]);
+                }
+            }
+            std::vector<uint64_t> overflowing;
+            for (uint64_t b = 0; b < num_blocks; b++) {
+                if (block_l[b] != overflow) continue;
+                uint64_t first = b * m_values_per_block;
+                uint64_t count = std::min(m_values_per_block, n - first);
+                blocks[b].words[0] = overflow | (overflowing.size() / m_values_per_block) << header_bits;
+                overflowing.insert(overflowing.end(), values.begin() + first, values.begin() + first + count);
+                overflowing.resize(overflowing.size() + m_values_per_block - count, 0);
+            }
+            m_blocks = std::move(blocks);
+            if (!overflowing.empty()) {
+                m_overflow.build(overflowing.begin(), overflowing.size());
+            }
+        }
+
+        inline uint64_t access(uint64_t i) const {
+            assert(i < size());
+            uint64_t block = i < (uint64_t(1) << 32) ? fastmod::fastdiv_u32(i, m_div) : i / m_values_per_block;
+            uint64_t j = i - block * m_values_per_block;
+            uint64_t const *words = m_blocks[block].words;
+            if ((words[0] & overflow) == overflow) {
+                return m_overflow.access((words[0] >> header_bits) * m_values_per_block + j);
+            }
+            return decode(words, j, m_values_per_block);
+        }
+
+        // value j of a block that does not overflow
+        static inline uint64_t decode(uint64_t const *words, uint64_t j, uint64_t values_per_block) {
+            uint64_t l = words[0] & overflow;
+
+            // A one in place of the header ends the (empty) unary code before the first value, so the code
+            // of value j starts behind the j-th one. Only the word of that one is searched without branches
+            // on the data, such that the misses of independent accesses overlap.
+            uint64_t unary[8];
+            uint64_t ones_before[8];
+            unary[0] = (words[0] & ~overflow) | uint64_t(1) << (header_bits - 1);
+            ones_before[0] = 0;
+            for (uint64_t w = 1; w < 8; w++) {
+                unary[w] = words[w];
+                ones_before[w] = ones_before[w - 1] + util::popcount(unary[w - 1]);
+            }
+            uint64_t word_idx = 0;
+            for (uint64_t w = 1; w < 8; w++) {
+                word_idx += ones_before[w] <= j;
+            }
+            uint64_t start = util::select64(unary[word_idx], j - ones_before[word_idx]);
+            // the code ends in the same word unless it is long or starts at the end of the word
+            uint64_t rest = unary[word_idx] >> start >> 1;
+            uint64_t high;
+            if (rest != 0) {
+                high = util::lsb(rest);
+            } else {
+                high = 63 - start;
+                while (unary[++word_idx] == 0) high += 64;
+                high += util::lsb(unary[word_idx]);
+            }
+
+            // blocks of small equal values have no low bits, and their low position is the end of the block
+            if (l == 0) {
+                return high;
+            }
+            // at most max_l bits starting in the byte of the first low bit, the word always ends inside the block
+            uint64_t low_pos = block_bits - values_per_block * l + j * l;
+            uint64_t low_byte = std::min(low_pos >> 3, block_bits / 8 - 8);
+            uint64_t low_word;
+            std::memcpy(&low_word, reinterpret_cast<char const *>(words) + low_byte, sizeof(low_word));
+            uint64_t low = (low_word >> (low_pos - low_byte * 8)) & ((uint64_t(1) << l) - 1);
+            return (high << l) | low;
+        }
+
+        inline void prefetch(uint64_t i) const {
+            util::prefetch(m_blocks.data() + i / m_values_per_block);
+        }
+
+        inline uint64_t size() const {
+            return m_size;
+        }
+
+        uint64_t values_per_block() const {
+            return m_values_per_block;
+        }
+
+        mappable_vector<util::cache_line> const &blocks() const {
+            return m_blocks;
+        }
+
+        // the values of the overflowing blocks, values_per_block() for each
+        compact_vector const &overflow_values() const {
+            return m_overflow;
+        }
+
+        uint64_t bytes() const {
+            return sizeof(m_size) + sizeof(m_values_per_block) + m_blocks.size() * sizeof(util::cache_line) +
+                   m_overflow.bytes();
+        }
+
+        template<typename Visitor>
+        void visit(Visitor &visitor) {
+            visitor.visit(m_size);
+            visitor.visit(m_values_per_block);
+            visitor.visit(m_blocks);
+            visitor.visit(m_overflow);
+            set_values_per_block(m_values_per_block);
+        }
+
+    private:
+        uint64_t m_size = 0;
+        uint64_t m_values_per_block = 1;
+        uint64_t m_div = fastmod::computeM_u32(1);
+        mappable_vector<util::cache_line> m_blocks;
+        compact_vector m_overflow;
+
+        void set_values_per_block(uint64_t values_per_block) {
+            m_values_per_block = values_per_block;
+            m_div = fastmod::computeM_u32(values_per_block);
+        }
+
+        // bits of count values with Rice parameter l, the low parts always take the space of a full block
+        static uint64_t code_bits(uint64_t const *values, uint64_t count, uint64_t values_per_block, uint64_t l) {
+            uint64_t high = 0;
+            for (uint64_t k = 0; k < count; k++) {
+                high += values[k] >> l;
+            }
+            return values_per_block * l + count + high;
+        }
+
+        // Rice parameter with the fewest bits for the values, the size is convex in l so it descends from the
+        // parameter for the mean value
+        static uint64_t optimal_l(uint64_t const *values, uint64_t count, uint64_t values_per_block, uint64_t &bits) {
+            uint64_t sum = std::accumulate(values, values + count, uint64_t(0));
+            uint64_t l = std::min<uint64_t>(sum < count ? 0 : util::msb(sum / count), max_l);
+            bits = code_bits(values, count, values_per_block, l);
+            while (l > 0) {
+                uint64_t smaller = code_bits(values, count, values_per_block, l - 1);
+                if (smaller > bits) break;
+                bits = smaller;
+                l--;
+            }
+            while (l < max_l) {
+                uint64_t larger = code_bits(values, count, values_per_block, l + 1);
+                if (larger >= bits) break;
+                bits = larger;
+                l++;
+            }
+            return l;
+        }
+
+        // Rice parameter that fits the values into a block or overflow if none does
+        static uint64_t best_l(uint64_t const *values, uint64_t count, uint64_t values_per_block) {
+            uint64_t bits;
+            uint64_t l = optimal_l(values, count, values_per_block, bits);
+            return bits <= block_bits - header_bits ? l : overflow;
+        }
+
+        // the number of values per block that minimizes the total space of the sample
+        static uint64_t best_values_per_block(const std::vector<uint64_t> &sample) {
+            uint64_t n = sample.size();
+            // blocks of half the values that fit on average are never better
+            uint64_t rice_bits;
+            optimal_l(sample.data(), n, n, rice_bits);
+            uint64_t best = std::max<uint64_t>(1, (block_bits - header_bits) * n / rice_bits / 2);
+            double best_bits_per_value = std::numeric_limits<double>::max();
+            for (uint64_t values_per_block = best; values_per_block <= block_bits - header_bits; values_per_block++) {
+                uint64_t bits = 0;
+                uint64_t overflow_blocks = 0;
+                for (uint64_t first = 0; first < n; first += values_per_block) {
+                    uint64_t count = std::min(values_per_block, n - first);
+                    bits += block_bits;
+                    if (best_l(sample.data() + first, count, values_per_block) == overflow) {
+                        uint64_t max = *std::max_element(sample.begin() + first, sample.begin() + first + count);
+                        bits += values_per_block * (max == 0 ? 1 : util::msb(max) + 1);
+                        overflow_blocks++;
+                    }
+                }
+                double bits_per_value = double(bits) / double(n);
+                if (bits_per_value < best_bits_per_value) {
+                    best = values_per_block;
+                    best_bits_per_value = bits_per_value;
+                }
+                if (overflow_blocks * 2 > (n + values_per_block - 1) / values_per_block) {
+                    // half of the blocks overflow, larger blocks only get worse
+                    break;
+                }
+            }
+            return best;
+        }
+
+        void write_block(util::cache_line &block, uint64_t const *values, uint64_t count, uint64_t l) const {
+            std::fill(block.words, block.words + 8, 0);
+            block.words[0] = l;
+            uint64_t pos = header_bits;
+            uint64_t low_begin = block_bits - m_values_per_block * l;
+            uint64_t low_mask = (uint64_t(1) << l) - 1;
+            for (uint64_t k = 0; k < count; k++) {
+                pos += values[k] >> l;
+                block.words[pos >> 6] |= uint64_t(1) << (pos & 63);
+                pos++;
+                set_bits(block.words, low_begin + k * l, values[k] & low_mask, l);
+            }
+            assert(pos <= low_begin);
+        }
+
+        static inline void set_bits(uint64_t *words, uint64_t pos, uint64_t value, uint64_t width) {
+            if (width == 0) return;
+            uint64_t word_idx = pos >> 6;
+            uint64_t shift = pos & 63;
+            words[word_idx] |= value << shift;
+            if (shift + width > 64) {
+                words[word_idx + 1] |= value >> (64 - shift);
+            }
+        }
+    };
+
+}
@@ -1,10 +1,17 @@
 #pragma once
 
-#include <vector>
+#include <algorithm>
 #include <cmath>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 #include <essentials.hpp>
 
+#include "mappable_vector.hpp"
+#include "util.hpp"
+
 namespace phobicgpu {
 
     struct compact_vector {
@@ -97,7 +104,20 @@ namespace phobicgpu {
             template<typename Iterator>
             void fill(Iterator begin, uint64_t n) {
                 if (!m_width) throw std::runtime_error("width must be greater than 0");
-                for (uint64_t i = 0; i != n; ++i, ++begin) push_back(*begin);
+                typedef typename std::iterator_traits<Iterator>::iterator_category category;
+                if constexpr (std::is_base_of_v<std::random_access_iterator_tag, category>) {
+                    // chunks of a multiple of 64 values start at word boundaries and can be written in parallel
+#pragma omp parallel for if(n >= 2 * parallel_chunk)
+                    for (uint64_t chunk = 0; chunk < n; chunk += parallel_chunk) {
+                        uint64_t end = std::min(n, chunk + parallel_chunk);
+                        for (uint64_t i = chunk; i != end; ++i) set(i, *(begin + i));
+                    }
+                    if (n) m_back = *(begin + (n - 1));
+                    m_cur_block = (n * m_width) >> 6;
+                    m_cur_shift = (n * m_width) & 63;
+                } else {
+                    for (uint64_t i = 0; i != n; ++i, ++begin) push_back(*begin);
+                }
             }
 
             void set(uint64_t i, uint64_t v) {
@@ -143,6 +163,9 @@ namespace phobicgpu {
                 }
             }
 
+            // values per chunk of a parallel fill
+            static constexpr uint64_t parallel_chunk = 64 * 1024;
+
             friend struct enumerator<builder>;
 
             typedef enumerator<builder> iterator;
@@ -159,7 +182,7 @@ namespace phobicgpu {
                 cv.m_size = m_size;
                 cv.m_width = m_width;
                 cv.m_mask = m_mask;
-                cv.m_bits.swap(m_bits);
+                cv.m_bits = std::move(m_bits);
                 builder().swap(*this);
             }
 
@@ -184,7 +207,7 @@ namespace phobicgpu {
                 return m_width;
             }
 
-            std::vector<uint64_t> &bits() {
+            huge_page_vector<uint64_t> &bits() {
                 return m_bits;
             }
 
@@ -195,7 +218,7 @@ namespace phobicgpu {
             uint64_t m_back;
             uint64_t m_cur_block;
             int64_t m_cur_shift;
-            std::vector<uint64_t> m_bits;
+            huge_page_vector<uint64_t> m_bits;
         };
 
         compact_vector() : m_size(0), m_width(0), m_mask(0) {}
@@ -203,7 +226,11 @@ namespace phobicgpu {
         template<typename Iterator>
         void build(Iterator begin, uint64_t n) {
             assert(n > 0);
-            uint64_t max = *std::max_element(begin, begin + n);
+            uint64_t max = 0;
+#pragma omp parallel for reduction(max : max) if(n >= 2 * builder::parallel_chunk)
+            for (uint64_t i = 0; i < n; i++) {
+                max = std::max<uint64_t>(max, *(begin + i));
+            }
             uint64_t width = max == 0 ? 1 : std::ceil(std::log2(max + 1));
             build(begin, n, width);
         }
@@ -232,6 +259,12 @@ namespace phobicgpu {
             return (*(reinterpret_cast<uint64_t const *>(ptr + (i >> 3))) >> (i & 7)) & m_mask;
         }
 
+        // loads the word read by access(pos) into the cache
+        inline void prefetch(uint64_t pos) const {
+            uint64_t i = pos * m_width;
+            util::prefetch(reinterpret_cast<const char *>(m_bits.data()) + (i >> 3));
+        }
+
         uint64_t back() const {
             return operator[](size() - 1);
         }
@@ -258,7 +291,7 @@ namespace phobicgpu {
             return iterator(this, pos);
         }
 
-        std::vector<uint64_t> const &bits() const {
+        mappable_vector<uint64_t> const &bits() const {
             return m_bits;
         }
 
@@ -279,13 +312,18 @@ namespace phobicgpu {
             visitor.visit(m_width);
             visitor.visit(m_mask);
             visitor.visit(m_bits);
+            // access() reads the word behind the last value, which the builder allocates
+            if (m_width > 64 || (m_size != 0 && m_bits.empty()) ||
+                (m_width != 0 && !m_bits.empty() && m_size > (m_bits.size() - 1) * 64 / m_width)) {
+                throw std::runtime_error("inconsistent compact_vector data");
+            }
         }
 
     private:
         uint64_t m_size;
         uint64_t m_width;
         uint64_t m_mask;
-        std::vector<uint64_t> m_bits;
+        mappable_vector<uint64_t> m_bits;
     };
 
 }
\ No newline at end of file
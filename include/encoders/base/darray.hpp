@@ -1,5 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
 #include "util.hpp"
 #include "bit_vector.hpp"
 
@@ -10,42 +14,100 @@ template <typename WordGetter>
 struct darray {
     darray() : m_positions(0) {}
 
+    // Builds the inventories of the blocks in parallel. The positions are counted per chunk of words first, which
+    // yields the word in which each block starts. The overflow positions of the sparse blocks are concatenated
+    // afterwards.
     void build(bit_vector const& bv) {
-        std::vector<uint64_t> const& data = bv.data();
-        std::vector<uint64_t> cur_block_positions;
-        std::vector<int64_t> block_inventory;
-        std::vector<uint16_t> subblock_inventory;
-        std::vector<uint64_t> overflow_positions;
-
-        for (size_t word_idx = 0; word_idx < data.size(); ++word_idx) {
-            size_t cur_pos = word_idx << 6;
-            uint64_t cur_word = WordGetter()(data, word_idx);
-            unsigned long l;
-            while (util::lsb(cur_word, l)) {
-                cur_pos += l;
-                cur_word >>= l;
-                if (cur_pos >= bv.size()) break;
-
-                cur_block_positions.push_back(cur_pos);
-
-                if (cur_block_positions.size() == block_size) {
-                    flush_cur_block(cur_block_positions, block_inventory, subblock_inventory,
-                                    overflow_positions);
+        mappable_vector<uint64_t> const& data = bv.data();
+        uint64_t num_words = std::min<uint64_t>(data.size(), essentials::words_for(bv.size()));
+        auto get_word = [&](uint64_t word_idx) {
+            uint64_t word = WordGetter()(data, word_idx);
+            uint64_t valid = bv.size() - (word_idx << 6);
+            return valid < 64 ? word & ((uint64_t(1) << valid) - 1) : word;
+        };
+
+        uint64_t chunks = (num_words + chunk_words - 1) / chunk_words;
+        std::vector<uint64_t> chunk_positions(chunks + 1, 0);
+#pragma omp parallel for if(chunks > 1)
+        for (uint64_t c = 0; c < chunks; c++) {
+            uint64_t positions = 0;
+            for (uint64_t w = c * chunk_words; w < std::min(num_words, (c + 1) * chunk_words); w++) {
+                positions += util::popcount(get_word(w));
+            }
+            chunk_positions[c + 1] = positions;
+        }
+        std::partial_sum(chunk_positions.begin(), chunk_positions.end(), chunk_positions.begin());
+        m_positions = chunk_positions[chunks];
+
+        // the word of the first position of each block and the positions in that word before it
+        uint64_t blocks = (m_positions + block_size - 1) / block_size;
+        std::vector<uint64_t> block_word(blocks);
+        std::vector<uint64_t> block_skip(blocks);
+#pragma omp parallel for if(chunks > 1)
+        for (uint64_t c = 0; c < chunks; c++) {
+            uint64_t rank = chunk_positions[c];
+            uint64_t block = (rank + block_size - 1) / block_size;
+            for (uint64_t w = c * chunk_words; w < std::min(num_words, (c + 1) * chunk_words); w++) {
+                uint64_t ones = util::popcount(get_word(w));
+                while (block < blocks && block * block_size < rank + ones) {
+                    block_word[block] = w;
+                    block_skip[block] = block * block_size - rank;
+                    block++;
                 }
+                rank += ones;
+            }
+        }
 
-                // can't do >>= l + 1, can be 64
-                cur_word >>= 1;
-                cur_pos += 1;
-                m_positions += 1;
+        huge_page_vector<int64_t> block_inventory(blocks);
+        huge_page_vector<uint16_t> subblock_inventory((m_positions + subblock_size - 1) / subblock_size);
+        std::vector<std::vector<uint64_t>> block_overflow(blocks);
+#pragma omp parallel for if(blocks > 1)
+        for (uint64_t block = 0; block < blocks; block++) {
+            uint64_t count = std::min<uint64_t>(block_size, m_positions - block * block_size);
+            std::vector<uint64_t> cur_block_positions;
+            cur_block_positions.reserve(count);
+            uint64_t word_idx = block_word[block];
+            uint64_t word = get_word(word_idx);
+            for (uint64_t k = 0; k < block_skip[block]; k++) word &= word - 1;
+            while (true) {
+                while (word && cur_block_positions.size() < count) {
+                    cur_block_positions.push_back((word_idx << 6) + util::lsb(word));
+                    word &= word - 1;
+                }
+                if (cur_block_positions.size() == count) break;
+                word = get_word(++word_idx);
+            }
+
+            uint16_t* subblocks = subblock_inventory.data() + block * (block_size / subblock_size);
+            if (cur_block_positions.back() - cur_block_positions.front() < max_in_block_distance) {
+                block_inventory[block] = int64_t(cur_block_positions.front());
+                for (size_t i = 0; i < count; i += subblock_size) {
+                    *subblocks++ = uint16_t(cur_block_positions[i] - cur_block_positions.front());
+                }
+            } else {
+                for (size_t i = 0; i < count; i += subblock_size) {
+                    *subblocks++ = uint16_t(-1);
+                }
+                block_overflow[block].swap(cur_block_positions);
             }
         }
-        if (cur_block_positions.size()) {
-            flush_cur_block(cur_block_positions, block_inventory, subblock_inventory,
-                            overflow_positions);
+
+        std::vector<uint64_t> overflow_begin(blocks + 1, 0);
+        for (uint64_t block = 0; block < blocks; block++) {
+            overflow_begin[block + 1] = overflow_begin[block] + block_overflow[block].size();
+            if (!block_overflow[block].empty()) {
+                block_inventory[block] = -int64_t(overflow_begin[block]) - 1;
+            }
+        }
+        huge_page_vector<uint64_t> overflow_positions(overflow_begin[blocks]);
+#pragma omp parallel for if(blocks > 1)
+        for (uint64_t block = 0; block < blocks; block++) {
+            std::copy(block_overflow[block].begin(), block_overflow[block].end(),
+                      overflow_positions.begin() + overflow_begin[block]);
         }
-        m_block_inventory.swap(block_inventory);
-        m_subblock_inventory.swap(subblock_inventory);
-        m_overflow_positions.swap(overflow_positions);
+        m_block_inventory = std::move(block_inventory);
+        m_subblock_inventory = std::move(subblock_inventory);
+        m_overflow_positions = std::move(overflow_positions);
     }
 
     inline uint64_t select(bit_vector const& bv, uint64_t idx) const {
@@ -62,7 +124,7 @@ struct darray {
         size_t reminder = idx & (subblock_size - 1);
         if (!reminder) return start_pos;
 
-        std::vector<uint64_t> const& data = bv.data();
+        mappable_vector<uint64_t> const& data = bv.data();
         size_t word_idx = start_pos >> 6;
         size_t word_shift = start_pos & 63;
         uint64_t word = WordGetter()(data, word_idx) & (uint64_t(-1) << word_shift);
@@ -75,6 +137,12 @@ struct darray {
         return (word_idx << 6) + util::select_in_word(word, reminder);
     }
 
+    // loads the inventory entries read by select(bv, idx) into the cache
+    inline void prefetch(uint64_t idx) const {
+        util::prefetch(m_block_inventory.data() + idx / block_size);
+        util::prefetch(m_subblock_inventory.data() + idx / subblock_size);
+    }
+
     inline uint64_t num_positions() const {
         return m_positions;
     }
@@ -94,46 +162,26 @@ struct darray {
     }
 
 protected:
-    static void flush_cur_block(std::vector<uint64_t>& cur_block_positions,
-                                std::vector<int64_t>& block_inventory,
-                                std::vector<uint16_t>& subblock_inventory,
-                                std::vector<uint64_t>& overflow_positions) {
-        if (cur_block_positions.back() - cur_block_positions.front() < max_in_block_distance) {
-            block_inventory.push_back(int64_t(cur_block_positions.front()));
-            for (size_t i = 0; i < cur_block_positions.size(); i += subblock_size) {
-                subblock_inventory.push_back(
-                    uint16_t(cur_block_positions[i] - cur_block_positions.front()));
-            }
-        } else {
-            block_inventory.push_back(-int64_t(overflow_positions.size()) - 1);
-            for (size_t i = 0; i < cur_block_positions.size(); ++i) {
-                overflow_positions.push_back(cur_block_positions[i]);
-            }
-            for (size_t i = 0; i < cur_block_positions.size(); i += subblock_size) {
-                subblock_inventory.push_back(uint16_t(-1));
-            }
-        }
-        cur_block_positions.clear();
-    }
-
-    static const size_t block_size = 4096;
-    static const size_t subblock_size = 64;
-    static const size_t max_in_block_distance = 1 << 16;
+    static constexpr size_t block_size = 4096;
+    static constexpr size_t subblock_size = 64;
+    static constexpr size_t max_in_block_distance = 1 << 16;
+    // words per chunk of the parallel counting
+    static constexpr size_t chunk_words = 1 << 14;
 
     size_t m_positions;
-    std::vector<int64_t> m_block_inventory;
-    std::vector<uint16_t> m_subblock_inventory;
-    std::vector<uint64_t> m_overflow_positions;
+    mappable_vector<int64_t> m_block_inventory;
+    mappable_vector<uint16_t> m_subblock_inventory;
+    mappable_vector<uint64_t> m_overflow_positions;
 };
 
 struct identity_getter {
-    uint64_t operator()(std::vector<uint64_t> const& data, size_t idx) const {
+    uint64_t operator()(mappable_vector<uint64_t> const& data, size_t idx) const {
         return data[idx];
     }
 };
 
 struct negating_getter {
-    uint64_t operator()(std::vector<uint64_t> const& data, size_t idx) const {
+    uint64_t operator()(mappable_vector<uint64_t> const& data, size_t idx) const {
         return ~data[idx];
     }
 };
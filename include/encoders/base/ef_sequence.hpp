@@ -71,6 +71,11 @@ struct ef_sequence {
         return val2 - val1;
     }
 
+    inline void prefetch(uint64_t i) const {
+        m_low_bits.prefetch(i);
+        m_high_bits_d1.prefetch(i);
+    }
+
     inline uint64_t size() const {
         return m_low_bits.size();
     }
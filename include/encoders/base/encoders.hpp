@@ -4,6 +4,7 @@
 #include "ef_sequence.hpp"
 #include "sdc_sequence.hpp"
 #include "rice_sequence.hpp"
+#include "blocked_rice_sequence.hpp"
 
 #include <vector>
 #include <unordered_map>
@@ -33,6 +34,10 @@ struct rice {
         return m_values.access(i);
     }
 
+    void prefetch(uint64_t i) const {
+        m_values.prefetch(i);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_values);
@@ -42,6 +47,46 @@ private:
     rice_sequence m_values;
 };
 
+// Rice codes with one cache miss per access, see blocked_rice_sequence
+struct blocked_rice {
+    template <typename Iterator>
+    void encode(Iterator begin, uint64_t n) {
+        m_values.encode(begin, n);
+    }
+
+    static std::string name() {
+        return "blocked_rice";
+    }
+
+    size_t size() const {
+        return m_values.size();
+    }
+
+    size_t num_bits() const {
+        return m_values.bytes() * 8;
+    }
+
+    uint64_t access(uint64_t i) const {
+        return m_values.access(i);
+    }
+
+    void prefetch(uint64_t i) const {
+        m_values.prefetch(i);
+    }
+
+    blocked_rice_sequence const& values() const {
+        return m_values;
+    }
+
+    template <typename Visitor>
+    void visit(Visitor& visitor) {
+        visitor.visit(m_values);
+    }
+
+private:
+    blocked_rice_sequence m_values;
+};
+
 struct compact {
     template <typename Iterator>
     void encode(Iterator begin, uint64_t n) {
@@ -64,6 +109,14 @@ struct compact {
         return m_values.access(i);
     }
 
+    void prefetch(uint64_t i) const {
+        m_values.prefetch(i);
+    }
+
+    compact_vector const& values() const {
+        return m_values;
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_values);
@@ -79,11 +132,13 @@ struct partitioned_compact {
 
     template <typename Iterator>
     void encode(Iterator begin, uint64_t n) {
+        m_size = n;
         uint64_t num_partitions = (n + partition_size - 1) / partition_size;
         bit_vector_builder bvb;
         bvb.reserve(32 * n);
-        m_bits_per_value.reserve(num_partitions + 1);
-        m_bits_per_value.push_back(0);
+        huge_page_vector<uint32_t> bits_per_value;
+        bits_per_value.reserve(num_partitions + 1);
+        bits_per_value.push_back(0);
         for (uint64_t i = 0, begin_partition = 0; i != num_partitions; ++i) {
             uint64_t end_partition = begin_partition + partition_size;
             if (end_partition > n) end_partition = n;
@@ -100,10 +155,11 @@ struct partitioned_compact {
             for (uint64_t k = begin_partition; k != end_partition; ++k) {
                 bvb.append_bits(*(begin + k), num_bits);
             }
-            assert(m_bits_per_value.back() + num_bits < (1ULL << 32));
-            m_bits_per_value.push_back(m_bits_per_value.back() + num_bits);
+            assert(bits_per_value.back() + num_bits < (1ULL << 32));
+            bits_per_value.push_back(bits_per_value.back() + num_bits);
             begin_partition = end_partition;
         }
+        m_bits_per_value = std::move(bits_per_value);
         m_values.build(&bvb);
     }
 
@@ -129,6 +185,14 @@ struct partitioned_compact {
         return m_values.get_bits(position, num_bits);
     }
 
+    // the headers take 4 bytes per partition and are usually cached, they give the word of the element
+    void prefetch(uint64_t i) const {
+        uint64_t partition = i / partition_size;
+        uint64_t num_bits = m_bits_per_value[partition + 1] - m_bits_per_value[partition];
+        uint64_t position = m_bits_per_value[partition] * partition_size + (i % partition_size) * num_bits;
+        util::prefetch(m_values.data().data() + position / 64);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_size);
@@ -138,41 +202,50 @@ struct partitioned_compact {
 
 private:
     uint64_t m_size;
-    std::vector<uint32_t> m_bits_per_value;
+    mappable_vector<uint32_t> m_bits_per_value;
     bit_vector m_values;
 };
 
+// Counts the values of chunks in thread local maps which are then merged. Codewords are assigned by
+// non-increasing frequency, ties by value such that the result does not depend on the threads.
 template <typename Iterator>
 std::pair<std::vector<uint64_t>, std::vector<uint64_t>> compute_ranks_and_dictionary(Iterator begin,
                                                                                      uint64_t n) {
-    // accumulate frequencies
-    std::unordered_map<uint64_t, uint64_t> distinct;
-    for (auto it = begin, end = begin + n; it != end; ++it) {
-        auto find_it = distinct.find(*it);
-        if (find_it != distinct.end()) {  // found
-            (*find_it).second += 1;
-        } else {
-            distinct[*it] = 1;
+    static const uint64_t parallel_chunk = 64 * 1024;
+    uint64_t chunks = (n + parallel_chunk - 1) / parallel_chunk;
+    std::vector<std::unordered_map<uint64_t, uint64_t>> chunk_distinct(chunks);
+#pragma omp parallel for if(chunks > 1)
+    for (uint64_t c = 0; c < chunks; c++) {
+        auto& distinct = chunk_distinct[c];
+        for (uint64_t i = c * parallel_chunk; i < std::min(n, (c + 1) * parallel_chunk); i++) {
+            distinct[*(begin + i)] += 1;
         }
     }
+    std::unordered_map<uint64_t, uint64_t> distinct;
+    for (auto& chunk : chunk_distinct) {
+        for (auto p : chunk) distinct[p.first] += p.second;
+        std::unordered_map<uint64_t, uint64_t>().swap(chunk);
+    }
+
     std::vector<std::pair<uint64_t, uint64_t>> vec;
     vec.reserve(distinct.size());
     for (auto p : distinct) vec.emplace_back(p.first, p.second);
-    std::sort(vec.begin(), vec.end(),
-              [](auto const& x, auto const& y) { return x.second > y.second; });
+    std::sort(vec.begin(), vec.end(), [](auto const& x, auto const& y) {
+        return x.second > y.second || (x.second == y.second && x.first < y.first);
+    });
     distinct.clear();
     // assign codewords by non-increasing frequency
     std::vector<uint64_t> dict;
-    dict.reserve(distinct.size());
+    dict.reserve(vec.size());
     for (uint64_t i = 0; i != vec.size(); ++i) {
         auto p = vec[i];
         distinct.insert({p.first, i});
         dict.push_back(p.first);
     }
 
-    std::vector<uint64_t> ranks;
-    ranks.reserve(n);
-    for (auto it = begin, end = begin + n; it != end; ++it) ranks.push_back(distinct[*it]);
+    std::vector<uint64_t> ranks(n);
+#pragma omp parallel for if(chunks > 1)
+    for (uint64_t i = 0; i < n; i++) ranks[i] = distinct.find(*(begin + i))->second;
     return {ranks, dict};
 }
 
@@ -201,6 +274,10 @@ struct dictionary {
         return m_dict.access(rank);
     }
 
+    void prefetch(uint64_t i) const {
+        m_ranks.prefetch(i);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_ranks);
@@ -235,6 +312,10 @@ struct elias_fano {
         return m_values.diff(i);
     }
 
+    void prefetch(uint64_t i) const {
+        m_values.prefetch(i);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_values);
@@ -269,6 +350,10 @@ struct sdc {
         return m_dict.access(rank);
     }
 
+    void prefetch(uint64_t i) const {
+        m_ranks.prefetch(i);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_ranks);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+
+namespace phobicgpu {
+
+static constexpr size_t huge_page_size = size_t(2) << 20;
+
+// Whether huge_page_allocator asks for transparent huge pages, disabled to compare against 4 KB pages.
+inline std::atomic<bool>& huge_pages_enabled() {
+    static std::atomic<bool> enabled(true);
+    return enabled;
+}
+
+// Allocates arrays of at least huge_page_size bytes as 2 MB aligned anonymous mappings that are advised to use
+// transparent huge pages before their first touch, such that random accesses to large encoders need few TLB
+// entries. Without huge pages in the kernel the advice fails and the mapping keeps 4 KB pages. Smaller arrays
+// use operator new.
+template <typename T>
+struct huge_page_allocator {
+    typedef T value_type;
+
+    huge_page_allocator() = default;
+
+    template <typename U>
+    huge_page_allocator(huge_page_allocator<U> const&) {}
+
+    T* allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < huge_page_size) {
+            return static_cast<T*>(::operator new(bytes, std::align_val_t(alignof(T))));
+        }
+        size_t length = mapped_bytes(bytes);
+        // over-allocate to cut out an aligned range
+        void* mapping = mmap(nullptr, length + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                             -1, 0);
+        if (mapping == MAP_FAILED) throw std::bad_alloc();
+        char* begin = static_cast<char*>(mapping);
+        char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(begin) + huge_page_size - 1) &
+                                                ~uintptr_t(huge_page_size - 1));
+        if (aligned != begin) munmap(begin, aligned - begin);
+        munmap(aligned + length, begin + huge_page_size - aligned);
+#if defined(MADV_HUGEPAGE)
+        // also opts out of transparent huge pages that the kernel uses for all mappings
+        madvise(aligned, length, huge_pages_enabled() ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+        return reinterpret_cast<T*>(aligned);
+    }
+
+    void deallocate(T* p, size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < huge_page_size) {
+            ::operator delete(p, std::align_val_t(alignof(T)));
+        } else {
+            munmap(p, mapped_bytes(bytes));
+        }
+    }
+
+    bool operator==(huge_page_allocator const&) const {
+        return true;
+    }
+
+    bool operator!=(huge_page_allocator const&) const {
+        return false;
+    }
+
+private:
+    static size_t mapped_bytes(size_t bytes) {
+        return (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+    }
+};
+
+template <typename T>
+using huge_page_vector = std::vector<T, huge_page_allocator<T>>;
+
+}  // namespace phobicgpu
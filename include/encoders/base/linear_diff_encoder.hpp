@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdlib>
+
 #include "encoders.hpp"
 
 namespace phobicgpu {
@@ -19,7 +21,7 @@ public:
         int64_t expected = 0;
         for (uint64_t i = 0; i != size; ++i, ++begin) {
             int64_t toEncode = *begin - expected;
-            uint64_t absToEncode = abs(toEncode);
+            uint64_t absToEncode = std::abs(toEncode);
             diffValues.push_back((absToEncode << 1) | uint64_t(toEncode > 0));
             expected += increment;
         }
@@ -46,8 +48,21 @@ public:
         return sValue + expected;
     }
 
+    inline void prefetch(uint64_t i) const {
+        enc.prefetch(i);
+    }
+
+    int64_t get_increment() const {
+        return increment;
+    }
+
+    BaseEncoder const& base() const {
+        return enc;
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
+        visitor.visit(increment);
         visitor.visit(enc);
     }
 };
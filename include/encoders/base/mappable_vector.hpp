@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "huge_page_allocator.hpp"
+
+namespace phobicgpu {
+
+// Read-only array that either owns its elements or points into externally
+// owned memory, e.g., a memory mapped file (see serialization.hpp). Owned
+// elements are allocated by huge_page_allocator.
+template <typename T>
+struct mappable_vector {
+    typedef T value_type;
+    typedef size_t size_type;
+    typedef T const* const_iterator;
+
+    mappable_vector() : m_data(nullptr), m_size(0), m_mapped(false) {}
+
+    mappable_vector(huge_page_vector<T>&& vec) : mappable_vector() {
+        *this = std::move(vec);
+    }
+
+    mappable_vector(mappable_vector const& other) : mappable_vector() {
+        *this = other;
+    }
+
+    mappable_vector(mappable_vector&& other) : mappable_vector() {
+        *this = std::move(other);
+    }
+
+    mappable_vector& operator=(huge_page_vector<T>&& vec) {
+        m_owned = std::move(vec);
+        m_mapped = false;
+        m_data = m_owned.data();
+        m_size = m_owned.size();
+        return *this;
+    }
+
+    mappable_vector& operator=(mappable_vector const& other) {
+        if (this == &other) return *this;
+        m_owned = other.m_owned;
+        m_mapped = other.m_mapped;
+        m_data = m_mapped ? other.m_data : m_owned.data();
+        m_size = other.m_size;
+        return *this;
+    }
+
+    mappable_vector& operator=(mappable_vector&& other) {
+        if (this == &other) return *this;
+        m_owned = std::move(other.m_owned);
+        m_mapped = other.m_mapped;
+        m_data = m_mapped ? other.m_data : m_owned.data();
+        m_size = other.m_size;
+        mappable_vector().swap(other);
+        return *this;
+    }
+
+    // the memory has to outlive this vector
+    void map(T const* data, size_t size) {
+        huge_page_vector<T>().swap(m_owned);
+        m_mapped = true;
+        m_data = data;
+        m_size = size;
+    }
+
+    void swap(mappable_vector& other) {
+        m_owned.swap(other.m_owned);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_mapped, other.m_mapped);
+    }
+
+    inline T const& operator[](size_t i) const {
+        return m_data[i];
+    }
+
+    inline T const* data() const {
+        return m_data;
+    }
+
+    inline size_t size() const {
+        return m_size;
+    }
+
+    inline bool empty() const {
+        return m_size == 0;
+    }
+
+    T const& front() const {
+        return m_data[0];
+    }
+
+    T const& back() const {
+        return m_data[m_size - 1];
+    }
+
+    const_iterator begin() const {
+        return m_data;
+    }
+
+    const_iterator end() const {
+        return m_data + m_size;
+    }
+
+    bool is_mapped() const {
+        return m_mapped;
+    }
+
+private:
+    huge_page_vector<T> m_owned;
+    T const* m_data;
+    size_t m_size;
+    bool m_mapped;
+};
+
+}  // namespace phobicgpu
@@ -1,7 +1,9 @@
 #pragma once
 
-#include <numeric>
+#include <algorithm>
 #include <cmath>
+#include <numeric>
+#include <vector>
 
 #include "bit_vector.hpp"
 #include "darray.hpp"
@@ -13,32 +15,69 @@ namespace phobicgpu {
 
         template<typename Iterator>
         uint64_t optimalL(Iterator begin, uint64_t n) {
-            uint64_t sum = std::accumulate(begin, begin + n, static_cast<uint64_t>(0));
+            uint64_t sum = 0;
+#pragma omp parallel for reduction(+ : sum) if(n >= 2 * parallel_chunk)
+            for (uint64_t i = 0; i < n; i++) {
+                sum += *(begin + i);
+            }
             double p = (n / (double(sum) + n));
             const double gold = log2(2.0 / (sqrt(5.0) + 1.0));
             int64_t res=int64_t(ceil(log2(gold / log2(1.0 - p))));
             return std::max(int64_t(0), res);
         }
 
+        // Encodes chunks of the values in parallel. The unary codes of a chunk start behind the ones of all
+        // previous chunks, so the chunks first sum up the length of their codes. Each chunk then sets the
+        // terminating ones of its codes word by word, the two words it may share with its neighbours are
+        // merged afterwards. The low bits are set with compact_vector::builder::set in the same pass, chunks hold
+        // a multiple of 64 values, so no two chunks share a word of the low bits.
         template<typename Iterator>
         void encode(Iterator begin, uint64_t n) {
             if (n == 0) return;
 
             uint64_t l = optimalL(begin, n);
+            uint64_t chunks = (n + parallel_chunk - 1) / parallel_chunk;
+            std::vector<uint64_t> chunk_begin(chunks + 1, 0);
+#pragma omp parallel for if(chunks > 1)
+            for (uint64_t c = 0; c < chunks; c++) {
+                uint64_t bits = 0;
+                for (uint64_t i = c * parallel_chunk; i < std::min(n, (c + 1) * parallel_chunk); i++) {
+                    bits += (uint64_t(*(begin + i)) >> l) + 1;
+                }
+                chunk_begin[c + 1] = bits;
+            }
+            std::partial_sum(chunk_begin.begin(), chunk_begin.end(), chunk_begin.begin());
 
-            bit_vector_builder bvb_high_bits;
+            bit_vector_builder bvb_high_bits(chunk_begin[chunks]);
+            huge_page_vector<uint64_t> &words = bvb_high_bits.data();
+            std::vector<uint64_t> first_words(chunks, 0);
+            std::vector<uint64_t> last_words(chunks, 0);
             compact_vector::builder cv_builder_low_bits(n, l);
-
             uint64_t low_mask = (uint64_t(1) << l) - 1;
-
-            for (size_t i = 0; i < n; ++i, ++begin) {
-                auto v = *begin;
-                cv_builder_low_bits.push_back(v & low_mask);
-                auto unary = v >> l;
-                for (size_t j = 0; j < unary; ++j) {
-                    bvb_high_bits.push_back(0);
+#pragma omp parallel for if(chunks > 1)
+            for (uint64_t c = 0; c < chunks; c++) {
+                uint64_t first_word = chunk_begin[c] >> 6;
+                uint64_t last_word = (chunk_begin[c + 1] - 1) >> 6;
+                uint64_t pos = chunk_begin[c];
+                for (uint64_t i = c * parallel_chunk; i < std::min(n, (c + 1) * parallel_chunk); i++) {
+                    uint64_t v = *(begin + i);
+                    pos += v >> l;
+                    uint64_t word = pos >> 6;
+                    uint64_t bit = uint64_t(1) << (pos & 63);
+                    if (word == first_word) {
+                        first_words[c] |= bit;
+                    } else if (word == last_word) {
+                        last_words[c] |= bit;
+                    } else {
+                        words[word] |= bit;
+                    }
+                    pos++;
+                    if (l) cv_builder_low_bits.set(i, v & low_mask);
                 }
-                bvb_high_bits.push_back(1);
+            }
+            for (uint64_t c = 0; c < chunks; c++) {
+                words[chunk_begin[c] >> 6] |= first_words[c];
+                words[(chunk_begin[c + 1] - 1) >> 6] |= last_words[c];
             }
 
             bit_vector(&bvb_high_bits).swap(m_high_bits);
@@ -46,14 +85,19 @@ namespace phobicgpu {
             m_high_bits_d1.build(m_high_bits);
         }
 
-    inline uint64_t access(uint64_t i) const {
-        assert(i < size());
-        int64_t start = -1;
-        if (i) { start = m_high_bits_d1.select(m_high_bits, i - 1); }
-        int64_t end = m_high_bits_d1.select(m_high_bits, i);
-        int64_t high = end - start - 1;
-        return (high << m_low_bits.width()) | m_low_bits.access(i);
-    }
+        inline uint64_t access(uint64_t i) const {
+            assert(i < size());
+            int64_t start = -1;
+            if (i) { start = m_high_bits_d1.select(m_high_bits, i - 1); }
+            int64_t end = m_high_bits_d1.select(m_high_bits, i);
+            int64_t high = end - start - 1;
+            return (high << m_low_bits.width()) | m_low_bits.access(i);
+        }
+
+        inline void prefetch(uint64_t i) const {
+            m_low_bits.prefetch(i);
+            m_high_bits_d1.prefetch(i);
+        }
 
         inline uint64_t size() const {
             return m_low_bits.size();
@@ -71,6 +115,10 @@ namespace phobicgpu {
         }
 
     private:
+        // values per chunk of a parallel encode, a multiple of 64 such that the low bits of the chunks do not share
+        // words
+        static constexpr uint64_t parallel_chunk = 64 * 1024;
+
         bit_vector m_high_bits;
         darray1 m_high_bits_d1;
         compact_vector m_low_bits;
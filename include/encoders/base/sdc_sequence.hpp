@@ -43,6 +43,10 @@ namespace phobicgpu {
             return value;
         }
 
+        inline void prefetch(uint64_t i) const {
+            m_index.prefetch(i);
+        }
+
         uint64_t size() const {
             return m_size;
         }
@@ -41,6 +41,15 @@ inline uint8_t lsb(uint64_t x) {
     return (uint8_t)ret;
 }
 
+inline void prefetch(void const* ptr) {
+    __builtin_prefetch(ptr);
+}
+
+// 64 byte aligned storage of encoders that read at most one cache line per access
+struct alignas(64) cache_line {
+    uint64_t words[8];
+};
+
 inline uint64_t popcount(uint64_t x) {
 #ifdef __SSE4_2__
     return static_cast<uint64_t>(_mm_popcnt_u64(x));
@@ -31,6 +31,14 @@ public:
         return enc.access(partition);
     }
 
+    inline void prefetch(uint64_t partition) const {
+        enc.prefetch(partition);
+    }
+
+    linear_diff_encoder<BaseEncoder> const& base() const {
+        return enc;
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(enc);
@@ -31,6 +31,10 @@ public:
         return enc.access(partition);
     }
 
+    inline void prefetch(uint64_t partition) const {
+        enc.prefetch(partition);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(enc);
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "encoders/base/encoders.hpp"
+
+namespace phobicgpu {
+
+    // How flat_interleaved_encoder stores the encoder of one bucket: a small descriptor and words in the arena
+    // shared by all buckets. access() decodes from both without touching the encoder object.
+    template<typename BaseEncoder>
+    struct flat_column {
+        static constexpr bool supported = false;
+    };
+
+    // the bits of the compact_vector, the descriptor holds their word offset and the width in the lowest byte
+    template<>
+    struct flat_column<compact> {
+        static constexpr bool supported = true;
+        // in words
+        static constexpr uint64_t alignment = 1;
+        typedef uint64_t descriptor;
+
+        static uint64_t words(const compact &column) {
+            return column.values().bits().size();
+        }
+
+        static descriptor place(const compact &column, uint64_t *arena, uint64_t offset) {
+            auto const &bits = column.values().bits();
+            std::copy(bits.begin(), bits.end(), arena + offset);
+            return offset << 8 | column.values().width();
+        }
+
+        static inline uint64_t const *bits(descriptor column, uint64_t const *arena) {
+            return arena + (column >> 8);
+        }
+
+        static inline uint64_t width(descriptor column) {
+            return column & 0xFF;
+        }
+
+        // as compact_vector::access, the word behind the bits of the column keeps the read inside the arena
+        static inline uint64_t access(descriptor column, uint64_t const *arena, uint64_t i) {
+            uint64_t pos = i * width(column);
+            uint64_t word;
+            std::memcpy(&word, reinterpret_cast<const char *>(bits(column, arena)) + (pos >> 3), sizeof(word));
+            return (word >> (pos & 7)) & ((uint64_t(1) << width(column)) - 1);
+        }
+
+        static inline void prefetch(descriptor column, uint64_t const *arena, uint64_t i) {
+            util::prefetch(reinterpret_cast<const char *>(bits(column, arena)) + ((i * width(column)) >> 3));
+        }
+    };
+
+    // the cache lines of the blocked_rice_sequence followed by the bits of its overflowing values
+    template<>
+    struct flat_column<blocked_rice> {
+        static constexpr bool supported = true;
+        // in words, the blocks start at a cache line
+        static constexpr uint64_t alignment = 8;
+        struct alignas(32) descriptor {
+            // word offsets of the blocks and of the overflowing values, the latter with their width in the lowest byte
+            uint64_t blocks;
+            uint64_t overflow;
+            uint64_t values_per_block;
+            uint64_t div;
+        };
+
+        static uint64_t words(const blocked_rice &column) {
+            return column.values().blocks().size() * 8 + column.values().overflow_values().bits().size();
+        }
+
+        static descriptor place(const blocked_rice &column, uint64_t *arena, uint64_t offset) {
+            const blocked_rice_sequence &values = column.values();
+            uint64_t overflow = offset + values.blocks().size() * 8;
+            for (uint64_t b = 0; b < values.blocks().size(); b++) {
+                std::copy(values.blocks()[b].words, values.blocks()[b].words + 8, arena + offset + b * 8);
+            }
+            auto const &bits = values.overflow_values().bits();
+            std::copy(bits.begin(), bits.end(), arena + overflow);
+            return {offset, overflow << 8 | values.overflow_values().width(), values.values_per_block(),
+                    fastmod::computeM_u32(values.values_per_block())};
+        }
+
+        static inline uint64_t access(const descriptor &column, uint64_t const *arena, uint64_t i) {
+            uint64_t block = i < (uint64_t(1) << 32) ? fastmod::fastdiv_u32(i, column.div) : i / column.values_per_block;
+            uint64_t j = i - block * column.values_per_block;
+            uint64_t const *words = arena + column.blocks + block * 8;
+            if ((words[0] & blocked_rice_sequence::overflow) == blocked_rice_sequence::overflow) {
+                return flat_column<compact>::access(column.overflow, arena,
+                                                    (words[0] >> blocked_rice_sequence::header_bits) *
+                                                    column.values_per_block + j);
+            }
+            return blocked_rice_sequence::decode(words, j, column.values_per_block);
+        }
+
+        static inline void prefetch(const descriptor &column, uint64_t const *arena, uint64_t i) {
+            util::prefetch(arena + column.blocks + i / column.values_per_block * 8);
+        }
+    };
+
+    // interleaved_encoder with the descriptors of all buckets in one array and all their data in one cache line
+    // aligned arena. An access reads the descriptor and then the data, instead of following the pointer of a
+    // separately allocated encoder, and the whole encoder is two arrays for serialization and memory mapping.
+    template<typename BaseEncoder>
+    struct flat_interleaved_encoder {
+        typedef flat_column<BaseEncoder> column;
+        static_assert(column::supported, "flat_interleaved_encoder requires a flat_column of the base encoder");
+
+        template<typename Iterator>
+        void encode(Iterator begin, uint64_t partitions, uint64_t buckets) {
+            std::vector<BaseEncoder> encoders(buckets);
+#pragma omp parallel for
+            for (size_t j = 0; j < buckets; j++) {
+                encoders[j].encode(begin + j * partitions, partitions);
+            }
+
+            std::vector<uint64_t> offsets(buckets);
+            uint64_t words = 0;
+            for (size_t j = 0; j < buckets; j++) {
+                offsets[j] = (words + column::alignment - 1) / column::alignment * column::alignment;
+                words = offsets[j] + column::words(encoders[j]);
+            }
+            huge_page_vector<util::cache_line> arena((words + 7) / 8);
+            huge_page_vector<typename column::descriptor> columns(buckets);
+#pragma omp parallel for
+            for (size_t j = 0; j < buckets; j++) {
+                columns[j] = column::place(encoders[j], reinterpret_cast<uint64_t *>(arena.data()), offsets[j]);
+                encoders[j] = BaseEncoder();
+            }
+            m_columns = std::move(columns);
+            m_arena = std::move(arena);
+        }
+
+        inline uint64_t access(uint64_t partition, uint64_t bucket) const {
+            return column::access(m_columns[bucket], arena(), partition);
+        }
+
+        inline void prefetch(uint64_t partition, uint64_t bucket) const {
+            column::prefetch(m_columns[bucket], arena(), partition);
+        }
+
+        uint64_t num_buckets() const {
+            return m_columns.size();
+        }
+
+        typename column::descriptor const &bucket_column(uint64_t bucket) const {
+            return m_columns[bucket];
+        }
+
+        uint64_t const *arena() const {
+            return reinterpret_cast<uint64_t const *>(m_arena.data());
+        }
+
+        std::string name() const {
+            return "FlatInterEncoder<" + BaseEncoder::name() + ">";
+        }
+
+        uint64_t num_bits() const {
+            return (m_columns.size() * sizeof(typename column::descriptor) +
+                    m_arena.size() * sizeof(util::cache_line)) * 8;
+        }
+
+        template<typename Visitor>
+        void visit(Visitor &visitor) {
+            visitor.visit(m_columns);
+            visitor.visit(m_arena);
+        }
+
+    private:
+        mappable_vector<typename column::descriptor> m_columns;
+        mappable_vector<util::cache_line> m_arena;
+    };
+}
@@ -18,8 +18,20 @@ namespace phobicgpu {
             return encoders[bucket].access(partition);
         }
 
+        inline void prefetch(uint64_t partition, uint64_t bucket) const {
+            encoders[bucket].prefetch(partition);
+        }
+
+        uint64_t num_buckets() const {
+            return encoders.size();
+        }
 
-        std::string name() {
+        BaseEncoder const &bucket_encoder(uint64_t bucket) const {
+            return encoders[bucket];
+        }
+
+
+        std::string name() const {
             return "InterEncoder<" + BaseEncoder::name() + ">";
         }
 
@@ -33,6 +45,11 @@ namespace phobicgpu {
 
         template<typename Visitor>
         void visit(Visitor &visitor) {
+            uint64_t buckets = encoders.size();
+            visitor.visit(buckets);
+            // every encoder stores at least the size of an array
+            visitor.checkItems(buckets, sizeof(uint64_t));
+            encoders.resize(buckets);
             for (auto &e: encoders) {
                 e.visit(visitor);
             }
@@ -32,7 +32,15 @@ namespace phobicgpu {
             }
         }
 
-        std::string name() {
+        inline void prefetch(uint64_t partition, uint64_t bucket) const {
+            if (bucket < buckets1) {
+                encoder1.prefetch(partition, bucket);
+            } else {
+                encoder2.prefetch(partition, bucket - buckets1);
+            }
+        }
+
+        std::string name() const {
             return "InterEncoderDual<" + BaseEncoder1::name() + "," + BaseEncoder2::name() + "," + std::to_string(tradeoff) + ">";
         }
 
@@ -42,6 +50,9 @@ namespace phobicgpu {
 
         template<typename Visitor>
         void visit(Visitor &visitor) {
+            visitor.visit(initialized);
+            visitor.visit(buckets1);
+            visitor.visit(tradeoff);
             encoder1.visit(visitor);
             encoder2.visit(visitor);
         }
@@ -17,7 +17,7 @@ public:
         enc.encode(begin, partitions * buckets);
     }
 
-    std::string name() {
+    std::string name() const {
         return BaseEncoder::name();
     }
 
@@ -33,8 +33,13 @@ public:
         return enc.access(partitions * bucket + partition);
     }
 
+    inline void prefetch(uint64_t partition, uint64_t bucket) const {
+        enc.prefetch(partitions * bucket + partition);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
+        visitor.visit(partitions);
         visitor.visit(enc);
     }
 };
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "xxHash/xxh3.h"
+
+namespace phobicgpu {
+
+    // XXH128 with seed 0 of many short strings at once. Keys of 9 to 16 and of 17 to 128 bytes are collected per
+    // length class and hashed in 64-bit SIMD lanes, one key per lane, all other keys are hashed by XXH128 directly.
+    // The results are bit-identical to XXH128, out receives the low and high word of each hash.
+    namespace batchhash {
+
+        static constexpr uint64_t PRIME32_2 = 0x85EBCA77ULL;
+        static constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+        static constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+        static constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+        static constexpr uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+
+        // the first 128 bytes of the default XXH3 secret, which are all that keys of up to 128 bytes use
+        alignas(64) static constexpr uint8_t SECRET[128] = {
+                0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+                0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+                0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+                0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+                0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+                0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+                0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+                0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+        };
+
+        inline uint64_t secretWord(size_t offset) {
+            uint64_t word;
+            std::memcpy(&word, SECRET + offset, sizeof(word));
+            return word;
+        }
+
+        inline void hashScalar(const std::string &key, uint64_t *out) {
+            XXH128_hash_t h = XXH128(key.data(), key.size(), 0);
+            out[0] = h.low64;
+            out[1] = h.high64;
+        }
+
+        // lower 64 bits of a * b from three 32x32 bit products
+        template<typename L>
+        inline typename L::V mulloFrom32(typename L::V a, typename L::V b) {
+            typename L::V cross = L::add(L::mul32(L::template srl<32>(a), b), L::mul32(a, L::template srl<32>(b)));
+            return L::add(L::mul32(a, b), L::template sll<32>(cross));
+        }
+
+#if defined(__AVX512F__)
+        struct Lanes {
+            typedef __m512i V;
+            static constexpr size_t COUNT = 8;
+
+            static inline V set1(uint64_t x) { return _mm512_set1_epi64(int64_t(x)); }
+            static inline V load(const uint64_t *src) { return _mm512_loadu_si512(src); }
+            static inline void store(uint64_t *dst, V a) { _mm512_storeu_si512(dst, a); }
+            static inline V add(V a, V b) { return _mm512_add_epi64(a, b); }
+            static inline V sub(V a, V b) { return _mm512_sub_epi64(a, b); }
+            static inline V bxor(V a, V b) { return _mm512_xor_si512(a, b); }
+            static inline V band(V a, V b) { return _mm512_and_si512(a, b); }
+            static inline V bor(V a, V b) { return _mm512_or_si512(a, b); }
+            template<int k> static inline V srl(V a) { return _mm512_srli_epi64(a, k); }
+            template<int k> static inline V sll(V a) { return _mm512_slli_epi64(a, k); }
+            // product of the lower 32 bits of each lane
+            static inline V mul32(V a, V b) { return _mm512_mul_epu32(a, b); }
+            // loads the words at the byte addresses addr
+            static inline V gather(V addr) { return _mm512_i64gather_epi64(addr, nullptr, 1); }
+#if defined(__AVX512DQ__)
+            static inline V mullo(V a, V b) { return _mm512_mullo_epi64(a, b); }
+#else
+            static inline V mullo(V a, V b) { return mulloFrom32<Lanes>(a, b); }
+#endif
+        };
+#elif defined(__AVX2__)
+        struct Lanes {
+            typedef __m256i V;
+            static constexpr size_t COUNT = 4;
+
+            static inline V set1(uint64_t x) { return _mm256_set1_epi64x(int64_t(x)); }
+            static inline V load(const uint64_t *src) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)); }
+            static inline void store(uint64_t *dst, V a) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), a); }
+            static inline V add(V a, V b) { return _mm256_add_epi64(a, b); }
+            static inline V sub(V a, V b) { return _mm256_sub_epi64(a, b); }
+            static inline V bxor(V a, V b) { return _mm256_xor_si256(a, b); }
+            static inline V band(V a, V b) { return _mm256_and_si256(a, b); }
+            static inline V bor(V a, V b) { return _mm256_or_si256(a, b); }
+            template<int k> static inline V srl(V a) { return _mm256_srli_epi64(a, k); }
+            template<int k> static inline V sll(V a) { return _mm256_slli_epi64(a, k); }
+            static inline V mul32(V a, V b) { return _mm256_mul_epu32(a, b); }
+            static inline V gather(V addr) { return _mm256_i64gather_epi64(nullptr, addr, 1); }
+            static inline V mullo(V a, V b) { return mulloFrom32<Lanes>(a, b); }
+        };
+#endif
+
+#if defined(__AVX2__)
+        template<typename L>
+        struct Kernel {
+            typedef typename L::V V;
+
+            // full 128-bit product from four 32x32 bit products
+            static inline void mul128(V a, V b, V &low, V &high) {
+                const V mask = L::set1(0xFFFFFFFFULL);
+                V aHi = L::template srl<32>(a);
+                V bHi = L::template srl<32>(b);
+                V loLo = L::mul32(a, b);
+                V hiLo = L::mul32(aHi, b);
+                V loHi = L::mul32(a, bHi);
+                V hiHi = L::mul32(aHi, bHi);
+                V cross = L::add(L::add(L::template srl<32>(loLo), L::band(hiLo, mask)), loHi);
+                high = L::add(L::add(L::template srl<32>(hiLo), L::template srl<32>(cross)), hiHi);
+                low = L::bor(L::template sll<32>(cross), L::band(loLo, mask));
+            }
+
+            static inline V swap64(V x) {
+                x = L::bor(L::template srl<8>(L::band(x, L::set1(0xFF00FF00FF00FF00ULL))),
+                           L::template sll<8>(L::band(x, L::set1(0x00FF00FF00FF00FFULL))));
+                x = L::bor(L::template srl<16>(L::band(x, L::set1(0xFFFF0000FFFF0000ULL))),
+                           L::template sll<16>(L::band(x, L::set1(0x0000FFFF0000FFFFULL))));
+                return L::bor(L::template srl<32>(x), L::template sll<32>(x));
+            }
+
+            static inline V avalanche(V h) {
+                h = L::bxor(h, L::template srl<37>(h));
+                h = L::mullo(h, L::set1(PRIME_MX1));
+                return L::bxor(h, L::template srl<32>(h));
+            }
+
+            static inline V mix16B(V in, size_t secretOffset) {
+                V lo = L::bxor(L::gather(in), L::set1(secretWord(secretOffset)));
+                V hi = L::bxor(L::gather(L::add(in, L::set1(8))), L::set1(secretWord(secretOffset + 8)));
+                V low, high;
+                mul128(lo, hi, low, high);
+                return L::bxor(low, high);
+            }
+
+            // XXH3_len_9to16_128b
+            static inline void len9to16(const uint64_t *ptr, const uint64_t *len, uint64_t *low, uint64_t *high) {
+                V p = L::load(ptr);
+                V l = L::load(len);
+                V inLo = L::gather(p);
+                V inHi = L::gather(L::sub(L::add(p, l), L::set1(8)));
+                V mLow, mHigh;
+                mul128(L::bxor(L::bxor(inLo, inHi), L::set1(secretWord(32) ^ secretWord(40))), L::set1(PRIME64_1),
+                       mLow, mHigh);
+                mLow = L::add(mLow, L::template sll<54>(L::sub(l, L::set1(1))));
+                inHi = L::bxor(inHi, L::set1(secretWord(48) ^ secretWord(56)));
+                mHigh = L::add(mHigh, L::add(inHi, L::mul32(inHi, L::set1(PRIME32_2 - 1))));
+                mLow = L::bxor(mLow, swap64(mHigh));
+                V hLow, hHigh;
+                mul128(mLow, L::set1(PRIME64_2), hLow, hHigh);
+                hHigh = L::add(hHigh, L::mullo(mHigh, L::set1(PRIME64_2)));
+                L::store(low, avalanche(hLow));
+                L::store(high, avalanche(hHigh));
+            }
+
+            // XXH3_len_17to128_128b for keys of 32 * (ROUNDS - 1) + 1 to 32 * ROUNDS bytes, the rounds run from
+            // the end of the key
+            template<int ROUNDS>
+            static inline void len17to128(const uint64_t *ptr, const uint64_t *len, uint64_t *low, uint64_t *high) {
+                V p = L::load(ptr);
+                V l = L::load(len);
+                V end = L::add(p, l);
+                V accLow = L::mullo(l, L::set1(PRIME64_1));
+                V accHigh = L::set1(0);
+                for (int round = ROUNDS - 1; round >= 0; round--) {
+                    V in1 = L::add(p, L::set1(16 * round));
+                    V in2 = L::sub(end, L::set1(16 * (round + 1)));
+                    V sum1 = L::add(L::gather(in1), L::gather(L::add(in1, L::set1(8))));
+                    V sum2 = L::add(L::gather(in2), L::gather(L::add(in2, L::set1(8))));
+                    accLow = L::bxor(L::add(accLow, mix16B(in1, 32 * round)), sum2);
+                    accHigh = L::bxor(L::add(accHigh, mix16B(in2, 32 * round + 16)), sum1);
+                }
+                V hLow = L::add(accLow, accHigh);
+                V hHigh = L::add(L::add(L::mullo(accLow, L::set1(PRIME64_1)), L::mullo(accHigh, L::set1(PRIME64_4))),
+                                 L::mullo(l, L::set1(PRIME64_2)));
+                L::store(low, avalanche(hLow));
+                L::store(high, L::sub(L::set1(0), avalanche(hHigh)));
+            }
+        };
+
+        // keys of one length class waiting for a full set of lanes
+        struct LaneBatch {
+            uint64_t ptr[Lanes::COUNT];
+            uint64_t len[Lanes::COUNT];
+            size_t index[Lanes::COUNT];
+            size_t count = 0;
+
+            template<typename Hash>
+            void add(const std::string &key, size_t i, uint64_t *out, Hash hash) {
+                ptr[count] = uint64_t(key.data());
+                len[count] = key.size();
+                index[count] = i;
+                if (++count == Lanes::COUNT) {
+                    flush(out, hash);
+                }
+            }
+
+            // unused lanes repeat the first key and are not written back
+            template<typename Hash>
+            void flush(uint64_t *out, Hash hash) {
+                if (count == 0) return;
+                for (size_t lane = count; lane < Lanes::COUNT; lane++) {
+                    ptr[lane] = ptr[0];
+                    len[lane] = len[0];
+                }
+                alignas(64) uint64_t low[Lanes::COUNT];
+                alignas(64) uint64_t high[Lanes::COUNT];
+                hash(ptr, len, low, high);
+                for (size_t lane = 0; lane < count; lane++) {
+                    out[2 * index[lane]] = low[lane];
+                    out[2 * index[lane] + 1] = high[lane];
+                }
+                count = 0;
+            }
+        };
+#endif
+
+        inline void hashStrings(const std::string *keys, size_t n, uint64_t *out) {
+#if defined(__AVX2__)
+            // keys of 17 to 128 bytes are grouped by their number of 32 byte rounds such that all lanes agree
+            typedef void (*LaneHash)(const uint64_t *, const uint64_t *, uint64_t *, uint64_t *);
+            static constexpr LaneHash hashRounds[4] = {Kernel<Lanes>::len17to128<1>, Kernel<Lanes>::len17to128<2>,
+                                                       Kernel<Lanes>::len17to128<3>, Kernel<Lanes>::len17to128<4>};
+            LaneBatch short9to16;
+            LaneBatch rounds[4];
+            for (size_t i = 0; i < n; i++) {
+                size_t length = keys[i].size();
+                if (length >= 9 && length <= 16) {
+                    short9to16.add(keys[i], i, out, Kernel<Lanes>::len9to16);
+                } else if (length >= 17 && length <= 128) {
+                    size_t r = (length - 1) / 32;
+                    rounds[r].add(keys[i], i, out, hashRounds[r]);
+                } else {
+                    hashScalar(keys[i], out + 2 * i);
+                }
+            }
+            short9to16.flush(out, Kernel<Lanes>::len9to16);
+            for (size_t r = 0; r < 4; r++) {
+                rounds[r].flush(out, hashRounds[r]);
+            }
+#else
+            for (size_t i = 0; i < n; i++) {
+                hashScalar(keys[i], out + 2 * i);
+            }
+#endif
+        }
+    }
+}
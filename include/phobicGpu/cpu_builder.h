@@ -0,0 +1,521 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "app/host_timer.h"
+#include "shader_constants.h"
+#include "mphf_config.h"
+#include "mphf.hpp"
+
+namespace phobicgpu {
+
+    // Builds functions like MPHFbuilder without requiring a GPU. Every method of CPUBuildInvocation mirrors one
+    // of the compute shaders, the search simulates the workGroupSize lanes of one workgroup in lockstep. The
+    // pilots are not reproducible, neither between runs nor against the GPU: the keys take their slots within
+    // a bucket in the order of atomic increments, and the search depends on that order.
+    class CPUMPHFbuilder {
+
+        template<typename Mphf, typename keyType>
+        friend
+        class CPUBuildInvocation;
+
+    private:
+        MPHFconfig config;
+        uint32_t workGroupSize;
+        std::vector<uint32_t> *positions = nullptr;
+
+    public:
+        CPUMPHFbuilder(MPHFconfig config = MPHFconfig(), uint32_t workGroupSize = 32) :
+                config(config),
+                workGroupSize(workGroupSize) {}
+
+        // as MPHFbuilder::setPositionOutput
+        void setPositionOutput(std::vector<uint32_t> *positions) {
+            this->positions = positions;
+        }
+
+        // partitions = 0 derives the number of partitions from the number of keys
+        template<typename Mphf, typename keyType>
+        HostTimer build(const std::vector<keyType> &keys, Mphf &f, uint32_t partitions = 0);
+    };
+
+    template<typename Mphf, typename keyType>
+    class CPUBuildInvocation {
+        Mphf &f;
+        const std::vector<keyType> &keysRaw;
+        // the hashed keys and their scattered lower halves are accessed randomly, see huge_page_allocator
+        huge_page_vector<Key> keys;
+        uint32_t size;
+        uint32_t partitions;
+        MPHFconfig config;
+        uint32_t workGroupSize;
+        uint32_t totalBucketCount;
+
+        std::vector<uint8_t> keyOffsets;
+        std::vector<uint32_t> bucketSizes;
+        std::vector<uint32_t> bucketSizeHistogram;
+        std::vector<uint32_t> partitionsSizes;
+        std::vector<uint32_t> partitionOffsetArray;
+        std::vector<uint32_t> bucketPermuatation;
+        huge_page_vector<uint32_t> keysLower;
+        std::vector<uint32_t> pilots;
+        std::vector<uint32_t> *positions;
+        // occupied positions of every partition for a remapped load factor below 1, see MPHF::setOccupancy
+        std::vector<uint32_t> occupancy;
+        uint64_t occupancyWords = 0;
+
+        // per thread state of the search stage, corresponds to the shared memory of one workgroup
+        struct SearchState {
+            std::vector<uint64_t> free;
+            std::vector<uint64_t> localCollisionArray;
+            std::vector<uint32_t> initialPos;
+            std::vector<uint32_t> pilotsFound;
+            std::vector<uint32_t> laneOffset;
+            std::vector<uint32_t> laneIndex;
+        };
+
+        // hashing.glsl
+        static inline uint32_t hash(uint32_t key, uint32_t pilot) {
+            key ^= pilot;
+            key = ((key >> 16) ^ key) * 0x45d9f3b;
+            key = ((key >> 16) ^ key) * 0x45d9f3b;
+            key = (key >> 16) ^ key;
+            return key;
+        }
+
+        // key_mapping.glsl
+        inline uint32_t assignBucketRelative(uint32_t keyUpper) const {
+            const std::vector<uint32_t> &fulcs = config.getFulcs();
+            uint64_t z = uint64_t(keyUpper) * uint64_t(FULCS_INTER - 1);
+            uint64_t index = z >> 32;
+            uint64_t part = z & 0xFFFFFFFF;
+            uint64_t v1 = (fulcs[index + 0] * part) >> 32;
+            uint64_t v2 = (fulcs[index + 1] * (0xFFFFFFFF - part)) >> 32;
+            return (v1 + v2) >> 16;
+        }
+
+        inline uint32_t assignPartition(uint32_t partitioner) const {
+            return (uint64_t(partitioner) * uint64_t(partitions)) >> 32;
+        }
+
+        inline uint32_t assignBucketAbsolute(const Key &key) const {
+            return assignBucketRelative(key.bucketer) + assignPartition(key.partitioner) * config.bucketCountPerPartition;
+        }
+
+    public:
+        CPUBuildInvocation(Mphf &f, const std::vector<keyType> &keysRaw, uint32_t partitions, MPHFconfig config,
+                           uint32_t workGroupSize, std::vector<uint32_t> *positions)
+                : f(f), keysRaw(keysRaw), partitions(partitions), config(config), workGroupSize(workGroupSize),
+                  positions(positions) {
+            size = keysRaw.size();
+            if (partitions == 0) {
+                // an empty key set keeps one empty partition, the encoders do not take empty sequences
+                this->partitions = std::max<uint32_t>(1, (size + config.partitionSize - 1) / config.partitionSize);
+            }
+            totalBucketCount = this->partitions * config.bucketCountPerPartition;
+        }
+
+        void allocateBuffers() {
+            keyOffsets.resize(size);
+            bucketSizes.assign(totalBucketCount, 0);
+            bucketSizeHistogram.assign(size_t(config.sortingBins) * partitions, 0);
+            partitionsSizes.resize(partitions);
+            partitionOffsetArray.resize(partitions + 1);
+            bucketPermuatation.resize(totalBucketCount);
+            keysLower.resize(2 * size_t(size));
+            // buckets without keys are never searched and keep a zero pilot
+            pilots.assign(totalBucketCount, 0);
+        }
+
+        const Key *initialHash() {
+            if constexpr (Mphf::noHash()) {
+                if constexpr(std::is_same_v<Key, keyType>) {
+                    return keysRaw.data();
+                } else {
+                    exit(1); // should be unreachable
+                }
+            } else {
+                keys.resize(keysRaw.size());
+#pragma omp parallel for
+                for (size_t i = 0; i < keysRaw.size(); i += HASH_BATCH_SIZE) {
+                    size_t batchEnd = std::min(i + HASH_BATCH_SIZE, keysRaw.size());
+                    Mphf::initialHashBatch(keysRaw.data() + i, batchEnd - i, keys.data() + i);
+                }
+                return keys.data();
+            }
+        }
+
+        // bucket_sizes.comp: count the keys per bucket and store the local bucket offset of each key
+        void bucketSizesStage(const Key *keyInput) {
+#pragma omp parallel for
+            for (size_t i = 0; i < size; i++) {
+                uint32_t bucket = assignBucketAbsolute(keyInput[i]);
+                uint32_t o;
+#pragma omp atomic capture
+                o = bucketSizes[bucket]++;
+                keyOffsets[i] = o;
+            }
+        }
+
+        // sort_sum.comp: sort the buckets by descending size and determine bucket offsets
+        void bucketSortStage() {
+            const uint32_t buckets = config.bucketCountPerPartition;
+            const uint32_t bins = config.sortingBins;
+            bool binOverflow = false;
+
+#pragma omp parallel
+            {
+                std::vector<uint32_t> bucketCntInBin(buckets);
+                std::vector<uint32_t> binOffsets(bins);
+                std::vector<uint32_t> binKeyOffsets(bins);
+
+#pragma omp for schedule(dynamic, 64) reduction(||:binOverflow)
+                for (size_t partition = 0; partition < partitions; partition++) {
+                    uint32_t *sizes = bucketSizes.data() + partition * buckets;
+                    uint32_t *histo = bucketSizeHistogram.data() + partition * bins;
+
+                    for (int64_t index = int64_t(buckets) - 1; index > -1; index--) {
+                        uint32_t bucketSize = sizes[index];
+                        if (bucketSize > bins) {
+                            binOverflow = true;
+                        } else if (bucketSize > 0) {
+                            bucketCntInBin[index] = histo[bins - bucketSize]++;
+                        }
+                    }
+
+                    // exclusive prefix sums of the bucket and key counts of the bins
+                    uint32_t bucketSum = 0;
+                    uint32_t keySum = 0;
+                    for (uint32_t i = 0; i < bins; i++) {
+                        binOffsets[i] = bucketSum;
+                        binKeyOffsets[i] = keySum;
+                        bucketSum += histo[i];
+                        keySum += histo[i] * (bins - i);
+                    }
+                    partitionsSizes[partition] = keySum;
+
+                    for (uint32_t index = 0; index < buckets; index++) {
+                        uint32_t bucketSize = sizes[index];
+                        if (bucketSize > 0 && bucketSize <= bins) {
+                            uint32_t bin = bins - bucketSize;
+                            bucketPermuatation[partition * buckets + binOffsets[bin] + bucketCntInBin[index]] = index;
+                            sizes[index] = binKeyOffsets[bin] + bucketCntInBin[index] * bucketSize;
+                        }
+                    }
+                }
+            }
+
+            if (binOverflow) {
+                throw std::runtime_error("bucket size exceeds the number of sorting bins");
+            }
+        }
+
+        // prefix_sum.comp: inclusive prefix sum over the partition sizes, with a leading zero
+        void partitionOffsetsStage() {
+            partitionOffsetArray[0] = 0;
+            for (size_t partition = 0; partition < partitions; partition++) {
+                partitionOffsetArray[partition + 1] = partitionOffsetArray[partition] + partitionsSizes[partition];
+            }
+        }
+
+        // apply_partition_offset.comp: apply the partition offsets to the bucket offsets
+        void applyPartitionOffsetStage() {
+            const uint32_t buckets = config.bucketCountPerPartition;
+#pragma omp parallel for
+            for (size_t partition = 0; partition < partitions; partition++) {
+                uint32_t offset = partitionOffsetArray[partition];
+                for (size_t i = partition * buckets; i < (partition + 1) * buckets; i++) {
+                    bucketSizes[i] += offset;
+                }
+            }
+        }
+
+        // redistribute_keys.comp: group the lower key bits by bucket in sorted bucket order
+        void redistributeKeysStage(const Key *keyInput) {
+#pragma omp parallel for
+            for (size_t i = 0; i < size; i++) {
+                const Key &key = keyInput[i];
+                size_t target = bucketSizes[assignBucketAbsolute(key)] + keyOffsets[i];
+                keysLower[2 * target] = key.lower1;
+                keysLower[2 * target + 1] = key.lower2;
+            }
+        }
+
+        inline uint32_t hash64(size_t globalIndex, uint32_t pilot) const {
+            return hash(keysLower[2 * globalIndex], hash(keysLower[2 * globalIndex + 1], pilot)) >> 1;
+        }
+
+        static inline bool testBit(const std::vector<uint64_t> &bits, uint32_t pos) {
+            return (bits[pos / 64] >> (pos % 64)) & 1;
+        }
+
+        static inline void setBit(std::vector<uint64_t> &bits, uint32_t pos) {
+            bits[pos / 64] |= uint64_t(1) << (pos % 64);
+        }
+
+        // 64 bits starting at pos, the bit vector is padded with one extra word
+        static inline uint64_t readWord(const std::vector<uint64_t> &bits, uint32_t pos) {
+            uint64_t word = bits[pos / 64] >> (pos % 64);
+            if (pos % 64) {
+                word |= bits[pos / 64 + 1] << (64 - pos % 64);
+            }
+            return word;
+        }
+
+        // bit j is set if position (start + j) mod partitionSize is occupied, requires partitionSize >= 64
+        static inline uint64_t occupiedWord(const std::vector<uint64_t> &bits, uint32_t start, uint32_t partitionSize) {
+            uint64_t word = readWord(bits, start);
+            uint32_t remaining = partitionSize - start;
+            if (remaining < 64) {
+                word &= (uint64_t(1) << remaining) - 1;
+                word |= readWord(bits, 0) << remaining;
+            }
+            return word;
+        }
+
+        bool hasFreeOffset(const SearchState &s, uint32_t bucketSize, uint32_t partitionSize) const {
+            if (partitionSize < 64) {
+                return true;
+            }
+            for (uint32_t offset = 0; offset < partitionSize; offset += 64) {
+                uint64_t valid = partitionSize - offset < 64 ? (uint64_t(1) << (partitionSize - offset)) - 1 : -1;
+                for (uint32_t i = 0; i < bucketSize && valid; i++) {
+                    uint32_t start = s.initialPos[i] + offset;
+                    if (start >= partitionSize) {
+                        start -= partitionSize;
+                    }
+                    valid &= ~occupiedWord(s.free, start, partitionSize);
+                }
+                if (valid) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // offset of the first free position at or cyclically after start or 0xFFFFFFFF
+        static inline uint32_t nextFree(const std::vector<uint64_t> &bits, uint32_t start, uint32_t partitionSize) {
+            uint32_t pos = start;
+            uint32_t scanned = 0;
+            while (scanned < partitionSize) {
+                uint64_t word = ~bits[pos / 64] >> (pos % 64);
+                uint32_t available = std::min(64 - pos % 64, partitionSize - pos);
+                if (word != 0 && uint32_t(__builtin_ctzll(word)) < available) {
+                    uint32_t offset = scanned + __builtin_ctzll(word);
+                    return offset < partitionSize ? offset : 0xFFFFFFFF;
+                }
+                scanned += available;
+                pos += available;
+                if (pos == partitionSize) {
+                    pos = 0;
+                }
+            }
+            return 0xFFFFFFFF;
+        }
+
+        // search.comp testPilot(): returns the offset found by the workgroup or 0xFFFFFFFF
+        uint32_t testPilot(SearchState &s, uint32_t bucketSize, uint32_t partitionSize, size_t globalBucketStartPos,
+                           uint32_t pilot) const {
+            for (uint32_t i = 0; i < bucketSize; i++) {
+                s.initialPos[i] = hash64(globalBucketStartPos + i, pilot) % partitionSize;
+            }
+
+            if (bucketSize == 1) {
+                // the lanes test consecutive blocks of offsets, so the first free position wins
+                return nextFree(s.free, s.initialPos[0], partitionSize);
+            } else {
+                bool localCollision = false;
+                uint32_t marked = 0;
+                for (; marked < bucketSize && !localCollision; marked++) {
+                    localCollision = testBit(s.localCollisionArray, s.initialPos[marked]);
+                    setBit(s.localCollisionArray, s.initialPos[marked]);
+                }
+                for (uint32_t i = 0; i < marked; i++) {
+                    s.localCollisionArray[s.initialPos[i] / 64] = 0;
+                }
+                if (localCollision) {
+                    return 0xFFFFFFFF;
+                }
+            }
+
+            // the workgroup tests every offset of a pilot without a valid one, skip them word-parallel
+            if (!hasFreeOffset(s, bucketSize, partitionSize)) {
+                return 0xFFFFFFFF;
+            }
+
+            // every lane starts at its own offset and fetches the next untested one on a collision,
+            // all lanes advance by one key per step until one of them placed the whole bucket
+            for (uint32_t lane = 0; lane < workGroupSize; lane++) {
+                s.laneOffset[lane] = lane;
+                s.laneIndex[lane] = 0;
+            }
+            uint32_t sharedOffset = workGroupSize;
+            uint32_t pilotFound = 0xFFFFFFFF;
+            bool active = true;
+            while (active && pilotFound == 0xFFFFFFFF) {
+                active = false;
+                for (uint32_t lane = 0; lane < workGroupSize; lane++) {
+                    uint32_t offset = s.laneOffset[lane];
+                    if (offset >= partitionSize) {
+                        continue;
+                    }
+                    active = true;
+                    uint32_t pos = s.initialPos[s.laneIndex[lane]] + offset;
+                    if (pos >= partitionSize) {
+                        pos -= partitionSize;
+                    }
+                    s.laneIndex[lane]++;
+                    if (testBit(s.free, pos)) {
+                        s.laneIndex[lane] = 0;
+                        s.laneOffset[lane] = sharedOffset++;
+                    } else if (s.laneIndex[lane] == bucketSize) {
+                        pilotFound = std::min(pilotFound, offset);
+                    }
+                }
+            }
+            return pilotFound;
+        }
+
+        // search.comp: perform the actual bijection searching, one partition per workgroup
+        void searchStage() {
+            const uint32_t buckets = config.bucketCountPerPartition;
+            const uint32_t bins = config.sortingBins;
+            if (config.remapped()) {
+                uint32_t maxSize = 0;
+                for (uint32_t partitionSize: partitionsSizes) {
+                    maxSize = std::max(maxSize, partitionSize);
+                }
+                occupancyWords = (config.partitionSlots(maxSize) + 31) / 32;
+                occupancy.assign(occupancyWords * partitions, 0);
+            }
+
+#pragma omp parallel
+            {
+                SearchState s;
+                s.initialPos.resize(bins);
+                s.pilotsFound.resize(buckets);
+                s.laneOffset.resize(workGroupSize);
+                s.laneIndex.resize(workGroupSize);
+
+#pragma omp for schedule(dynamic, 1)
+                for (size_t partition = 0; partition < partitions; partition++) {
+                    uint32_t partitionSize = config.partitionSlots(partitionsSizes[partition]);
+                    s.free.assign((partitionSize + 63) / 64 + 1, 0);
+                    s.localCollisionArray.assign((partitionSize + 63) / 64, 0);
+
+                    size_t globalBucketStartPos = partitionOffsetArray[partition];
+                    uint32_t bucketCnt = 0;
+                    for (uint32_t i = 0; i < bins; i++) {
+                        uint32_t bucketSize = bins - i;
+                        uint32_t cnt = bucketSizeHistogram[i + partition * bins];
+                        for (uint32_t j = 0; j < cnt; j++) {
+                            uint32_t pilot = 0;
+                            uint32_t offset;
+                            while ((offset = testPilot(s, bucketSize, partitionSize, globalBucketStartPos, pilot)) ==
+                                   0xFFFFFFFF) {
+                                pilot++;
+                            }
+
+                            // mark occupied
+                            for (uint32_t k = 0; k < bucketSize; k++) {
+                                uint32_t pos = s.initialPos[k] + offset;
+                                if (pos >= partitionSize) {
+                                    pos -= partitionSize;
+                                }
+                                setBit(s.free, pos);
+                            }
+                            s.pilotsFound[bucketCnt] = offset + partitionSize * pilot;
+
+                            bucketCnt++;
+                            globalBucketStartPos += bucketSize;
+                        }
+                    }
+
+                    // write back result
+                    for (uint32_t index = 0; index < bucketCnt; index++) {
+                        size_t globalIndex = partition + size_t(bucketPermuatation[index + partition * buckets]) * partitions;
+                        pilots[globalIndex] = s.pilotsFound[index];
+                    }
+                    if (config.remapped()) {
+                        uint32_t *bitmap = occupancy.data() + partition * occupancyWords;
+                        for (uint32_t word = 0; word < (partitionSize + 31) / 32; word++) {
+                            bitmap[word] = uint32_t(s.free[word / 2] >> (32 * (word % 2)));
+                        }
+                    }
+                }
+            }
+        }
+
+        // query.comp on the unencoded pilots, the positions are the ones before remapping
+        void positionsStage(const Key *keyInput) {
+            std::vector<uint32_t> bounds(partitions + 1, 0);
+            for (uint32_t partition = 0; partition < partitions; partition++) {
+                bounds[partition + 1] = bounds[partition] + config.partitionSlots(partitionsSizes[partition]);
+            }
+            positions->resize(size);
+#pragma omp parallel for
+            for (size_t i = 0; i < size; i++) {
+                const Key &key = keyInput[i];
+                uint32_t partition = assignPartition(key.partitioner);
+                uint32_t pilot = pilots[size_t(assignBucketRelative(key.bucketer)) * partitions + partition];
+                uint32_t offset = bounds[partition];
+                uint32_t partitionSize = bounds[partition + 1] - offset;
+                uint32_t hashValue = hash(key.lower1, hash(key.lower2, pilot / partitionSize)) >> 1;
+                (*positions)[i] = offset + (hashValue + pilot) % partitionSize;
+            }
+        }
+
+        HostTimer run() {
+            HostTimer totalTimer;
+
+            const Key *keyInput = initialHash();
+            totalTimer.addLabel("initial_hash");
+            allocateBuffers();
+            totalTimer.addLabel("allocation");
+
+            bucketSizesStage(keyInput);
+            totalTimer.addLabel("CPU_bucket_sizes");
+            bucketSortStage();
+            totalTimer.addLabel("CPU_bucket_sorting");
+            partitionOffsetsStage();
+            totalTimer.addLabel("CPU_partition_offsets");
+            applyPartitionOffsetStage();
+            totalTimer.addLabel("CPU_apply_partition_offsets");
+            redistributeKeysStage(keyInput);
+            totalTimer.addLabel("CPU_key_redistribution");
+            searchStage();
+            totalTimer.addLabel("CPU_search");
+            if (positions != nullptr) {
+                positionsStage(keyInput);
+                totalTimer.addLabel("CPU_positions");
+            }
+
+            f.setData(pilots, partitionOffsetArray, partitions, config);
+            if (config.remapped()) {
+                f.setOccupancy(occupancy, occupancyWords);
+            }
+            totalTimer.addLabel("encoding");
+            if (positions != nullptr && config.remapped()) {
+#pragma omp parallel for
+                for (size_t i = 0; i < size; i++) {
+                    (*positions)[i] = uint32_t(f.remapPosition((*positions)[i]));
+                }
+                totalTimer.addLabel("CPU_positions_remap");
+            }
+            return totalTimer;
+        }
+    };
+
+
+    template<typename Mphf, typename keyType>
+    HostTimer CPUMPHFbuilder::build(const std::vector<keyType> &keys, Mphf &f, uint32_t partitions) {
+        if (keys.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("more than 2^32 keys require StreamingMPHFbuilder");
+        }
+        CPUBuildInvocation<Mphf, keyType> bd(f, keys, partitions, config, workGroupSize, positions);
+        return bd.run();
+    }
+}
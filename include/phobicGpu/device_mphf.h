@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "app/app.h"
+#include "app/command_buffer.h"
+#include "device_query_data.hpp"
+#include "mphf.hpp"
+#include "query_stage.h"
+
+namespace phobicgpu {
+
+    // Device resident copy of a built function that evaluates it for keys in device buffers, e.g., as the index of
+    // a hash join whose probes never leave the device. The keys are Keys computed by Mphf::initialHash, the results
+    // are the uint32_t values of Mphf::operator(). Requires a function with at most 2^32 keys.
+    class DeviceMPHF {
+    private:
+        App &app;
+        QueryStage queryStage;
+        PushStructQuery dimensions;
+
+        BufferAllocation fulcrums;
+        BufferAllocation partitionOffsets;
+        BufferAllocation pilotColumns;
+        BufferAllocation pilotBits;
+        BufferAllocation remap;
+
+        // buffers of query(), grown to the largest batch so far
+        uint32_t queryCapacity = 0;
+        BufferAllocation queryKeys;
+        BufferAllocation queryResults;
+        CommandBuffer *cb = nullptr;
+
+        static BufferAllocation uploadArray(App &app, const std::vector<uint32_t> &values) {
+            // empty buffers are not allowed, e.g., the pilots of a function whose pilots are all zero
+            BufferAllocation buffer = app.memoryAlloc.createDeviceLocalBuffer(
+                    sizeof(uint32_t) * std::max<size_t>(values.size(), 1), vk::BufferUsageFlagBits::eTransferDst);
+            if (!values.empty()) {
+                app.memoryAlloc.upload(buffer, values.data(), sizeof(uint32_t) * values.size());
+            }
+            return buffer;
+        }
+
+        void reserveQuery(uint32_t size) {
+            if (size <= queryCapacity) {
+                return;
+            }
+            if (queryCapacity != 0) {
+                queryKeys.free(app.memoryAlloc);
+                queryResults.free(app.memoryAlloc);
+            }
+            queryCapacity = size;
+            queryKeys = app.memoryAlloc.createDeviceLocalBuffer(sizeof(Key) * size,
+                                                                vk::BufferUsageFlagBits::eTransferDst);
+            queryResults = app.memoryAlloc.createDeviceLocalBuffer(sizeof(uint32_t) * size,
+                                                                   vk::BufferUsageFlagBits::eTransferSrc);
+        }
+
+    public:
+        template<typename Mphf>
+        DeviceMPHF(const Mphf &f) : app(App::getInstance()), queryStage(app, app.subGroupSize) {
+            DeviceQueryData data;
+            f.getDeviceQueryData(data);
+            dimensions = {0, data.partitions, data.bucketCountPerPartition, data.keyCount};
+            fulcrums = uploadArray(app, data.fulcs);
+            partitionOffsets = uploadArray(app, data.partitionOffsets);
+            pilotColumns = uploadArray(app, data.pilotColumns);
+            pilotBits = uploadArray(app, data.pilotBits);
+            remap = uploadArray(app, data.remap);
+        }
+
+        // Records the evaluation of the size Keys in keys into the uint32_t array results. The caller orders
+        // the commands with the ones that write the keys and read the results, e.g., by pipeline barriers.
+        void addCommands(CommandBuffer *cb, vk::Buffer keys, vk::Buffer results, uint32_t size) {
+            if (size == 0) {
+                return;
+            }
+            PushStructQuery constants = dimensions;
+            constants.size = size;
+            queryStage.addCommands(cb, constants, keys, partitionOffsets.buffer, pilotColumns.buffer,
+                                   pilotBits.buffer, remap.buffer, results, fulcrums.buffer);
+        }
+
+        // Evaluates the function for keys of the host on the device, e.g., to verify the device against
+        // Mphf::operator(). Keys and results are copied through the staging ring.
+        void query(const std::vector<Key> &keys, std::vector<uint32_t> &results) {
+            if (keys.size() > std::numeric_limits<uint32_t>::max()) {
+                throw std::runtime_error("device queries take at most 2^32 keys at once");
+            }
+            uint32_t size = uint32_t(keys.size());
+            results.resize(size);
+            if (size == 0) {
+                return;
+            }
+            reserveQuery(size);
+            app.memoryAlloc.upload(queryKeys, keys.data(), sizeof(Key) * size);
+            if (cb == nullptr) {
+                cb = app.createCommandBuffer();
+            } else {
+                cb->descrAlloc.reset();
+            }
+            cb->begin();
+            addCommands(cb, queryKeys.buffer, queryResults.buffer, size);
+            cb->submit(app.device, app.computeQueue, true);
+            app.memoryAlloc.download(queryResults, results.data(), sizeof(uint32_t) * size);
+        }
+
+        void destroy() {
+            fulcrums.free(app.memoryAlloc);
+            partitionOffsets.free(app.memoryAlloc);
+            pilotColumns.free(app.memoryAlloc);
+            pilotBits.free(app.memoryAlloc);
+            remap.free(app.memoryAlloc);
+            if (queryCapacity != 0) {
+                queryKeys.free(app.memoryAlloc);
+                queryResults.free(app.memoryAlloc);
+                queryCapacity = 0;
+            }
+            if (cb != nullptr) {
+                cb->destroy(app.device, app.computeCommandPool);
+                delete cb;
+                cb = nullptr;
+            }
+        }
+    };
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace phobicgpu {
+
+    // Encoding of a function that the query stage reads on the device, produced by MPHF::getDeviceQueryData.
+    // The pilots of bucket b are stored with pilotColumns[2 * b + 1] bits per partition, starting at word
+    // pilotColumns[2 * b] of pilotBits. This is the layout of flat_interleaved_encoder<compact> with 32-bit words,
+    // which shaders read without 64-bit integers. The partitions + 1 global partition offsets are stored plainly,
+    // they take 32 bits per partition of thousands of keys. A function built with a load factor below 1 and
+    // remapped stores the free position below keyCount of every position from keyCount on in remap, otherwise
+    // keyCount is 2^32 - 1 and remap is empty.
+    struct DeviceQueryData {
+        uint32_t partitions = 0;
+        uint32_t bucketCountPerPartition = 0;
+        uint32_t keyCount = 0;
+        std::vector<uint32_t> fulcs;
+        std::vector<uint32_t> partitionOffsets;
+        std::vector<uint32_t> pilotColumns;
+        std::vector<uint32_t> pilotBits;
+        std::vector<uint32_t> remap;
+    };
+
+}
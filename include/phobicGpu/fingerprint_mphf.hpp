@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "app/host_timer.h"
+#include "encoders/base/compact_vector.hpp"
+#include "encoders/base/huge_page_allocator.hpp"
+#include "hasher.hpp"
+
+namespace phobicgpu {
+
+    // A function with a fingerprint of fingerprintBits bits per position, such that find() recognizes keys outside
+    // of the build with a false positive rate of 2^-fingerprintBits. The fingerprint is taken from lower1 and
+    // lower2 of the Key, the position depends on them only through the hash with the pilot, so a foreign key
+    // that lands on the position of a key matches its fingerprint by chance.
+    template<typename Mphf>
+    class FingerprintMphf {
+    private:
+        Mphf f;
+        uint64_t fingerprintBits = 0;
+        compact_vector fingerprints;
+
+        static inline uint64_t fingerprint(const Key &key, uint64_t bits) {
+            uint64_t lower = uint64_t(key.lower2) << 32 | key.lower1;
+            return (lower * 0x9E3779B97F4A7C15ull) >> (64 - bits);
+        }
+
+        inline uint64_t check(const Key &key, uint64_t position) const {
+            return fingerprints.access(position) == fingerprint(key, fingerprintBits) ? position : NOT_FOUND;
+        }
+
+    public:
+        // result of find() for keys that are not in the function
+        static constexpr uint64_t NOT_FOUND = std::numeric_limits<uint64_t>::max();
+
+        // Builds the function with builder (MPHFbuilder or CPUMPHFbuilder) and stores the fingerprints of the keys
+        // at the positions of the builder's position output, see setPositionOutput.
+        template<typename Builder, typename keyType>
+        HostTimer build(Builder &builder, const std::vector<keyType> &keys, uint32_t fingerprintBits = 8) {
+            if (fingerprintBits == 0 || fingerprintBits > 32) {
+                throw std::runtime_error("fingerprints take 1 to 32 bits");
+            }
+            std::vector<uint32_t> positions;
+            builder.setPositionOutput(&positions);
+            HostTimer timer;
+            try {
+                timer = builder.build(keys, f);
+            } catch (...) {
+                builder.setPositionOutput(nullptr);
+                throw;
+            }
+            builder.setPositionOutput(nullptr);
+
+            this->fingerprintBits = fingerprintBits;
+            size_t n = keys.size();
+            // positions without a key keep a zero fingerprint, they only exist below a load factor of 1
+            huge_page_vector<uint32_t> scattered(f.range());
+#pragma omp parallel for
+            for (size_t begin = 0; begin < n; begin += HASH_BATCH_SIZE) {
+                size_t end = std::min(begin + HASH_BATCH_SIZE, n);
+                Key hashed[HASH_BATCH_SIZE];
+                Mphf::initialHashBatch(keys.data() + begin, end - begin, hashed);
+                for (size_t i = begin; i < end; i++) {
+                    scattered[positions[i]] = fingerprint(hashed[i - begin], fingerprintBits);
+                }
+            }
+            fingerprints = compact_vector();
+            if (n != 0) {
+                fingerprints.build(scattered.begin(), scattered.size(), fingerprintBits);
+            }
+            timer.addLabel("fingerprints");
+            return timer;
+        }
+
+        // the position of the key, or NOT_FOUND if it is not in the function except for false positives
+        template<typename keyType>
+        inline uint64_t find(const keyType &keyRaw) const {
+            Key key = Mphf::initialHash(keyRaw);
+            return check(key, f.lookup_hashed(key));
+        }
+
+        template<typename keyType>
+        inline bool contains(const keyType &keyRaw) const {
+            return find(keyRaw) != NOT_FOUND;
+        }
+
+        // find() for n keys, the fingerprints of a window are prefetched before they are compared
+        template<typename keyType>
+        void find_batch(const keyType *keys, size_t n, uint64_t *out) const {
+            Key windowKeys[Mphf::LOOKUP_WINDOW];
+            for (size_t begin = 0; begin < n; begin += Mphf::LOOKUP_WINDOW) {
+                size_t windowSize = std::min(Mphf::LOOKUP_WINDOW, n - begin);
+                Mphf::initialHashBatch(keys + begin, windowSize, windowKeys);
+                f.lookup_hashed_batch(windowKeys, windowSize, out + begin);
+                for (size_t i = 0; i < windowSize; i++) {
+                    fingerprints.prefetch(out[begin + i]);
+                }
+                for (size_t i = 0; i < windowSize; i++) {
+                    out[begin + i] = check(windowKeys[i], out[begin + i]);
+                }
+            }
+        }
+
+        // number of keys
+        uint64_t size() const {
+            return f.size();
+        }
+
+        const Mphf &function() const {
+            return f;
+        }
+
+        float getBitsPerKey() const {
+            return f.getBitsPerKey() + float(fingerprints.bytes() * 8) / float(size());
+        }
+
+        // type tag stored in serialized functions
+        std::string name() const {
+            return "FingerprintMphf<" + f.name() + "," + std::to_string(fingerprintBits) + ">";
+        }
+
+        template<typename Visitor>
+        void visit(Visitor &visitor) {
+            visitor.visit(f);
+            visitor.visit(fingerprintBits);
+            visitor.visit(fingerprints);
+        }
+    };
+
+}
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <string>
+#include <utility>
+
 #include "xxHash/xxh3.h"
+#include "batch_hasher.hpp"
 
 namespace phobicgpu {
 
+    // number of keys the host builders pass to one hash_batch call
+    static constexpr size_t HASH_BATCH_SIZE = 256;
+
     struct Key {
         uint32_t partitioner;
         uint32_t bucketer;
@@ -21,13 +29,24 @@ namespace phobicgpu {
 
 
     struct nohash {
+        static std::string name() {
+            return "none";
+        }
+
         static inline const Key &hash(const Key &val) {
             return val;
         }
+
+        static inline void hash_batch(const Key *vals, size_t n, Key *out) {
+            std::copy(vals, vals + n, out);
+        }
     };
 
 
     struct xxhash {
+        static std::string name() {
+            return "xx";
+        }
 
         // specialization for std::string
         static inline Key hash(std::string const &val) {
@@ -64,6 +83,19 @@ namespace phobicgpu {
             ((uint64_t*)&out)[1] = ha.high64;
             return out;
         }
+
+        // hashes n values into out, equal to calling hash for each of them
+        template<typename T>
+        static inline void hash_batch(const T *vals, size_t n, Key *out) {
+            for (size_t i = 0; i < n; i++) {
+                out[i] = hash(vals[i]);
+            }
+        }
+
+        // short strings are hashed in SIMD lanes
+        static inline void hash_batch(const std::string *vals, size_t n, Key *out) {
+            batchhash::hashStrings(vals, n, (uint64_t*)out);
+        }
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "app/app.h"
+#include "app/command_buffer.h"
+
+namespace phobicgpu {
+
+    struct PushStructInitialHash {
+        uint32_t size;
+        uint32_t firstKey;
+    };
+
+    // Computes the xxhash Key of raw keys on the device, either of strings packed into a character arena
+    // with size + 1 start offsets or of 64-bit integers. Requires the shaderInt64 device feature.
+    class InitialHashStage {
+    private:
+        App &app;
+        const ShaderStage *stringStage = nullptr;
+        const ShaderStage *integerStage = nullptr;
+
+        uint32_t workGroupSize;
+
+    public:
+        InitialHashStage(App &app, uint32_t workGroupSize);
+
+        bool available() const {
+            return stringStage != nullptr;
+        }
+
+        // writes the keys firstKey to firstKey + size - 1, offsets is ignored for integer keys
+        void addCommands(CommandBuffer *cb, PushStructInitialHash constants, bool stringKeys, vk::Buffer raw,
+                         vk::Buffer offsets, vk::Buffer keys);
+    };
+}
@@ -1,25 +1,48 @@
 #pragma once
 
+#include <limits>
+#include <stdexcept>
+
 #include "shader_constants.h"
 #include "mphf_config.h"
 #include "encoders/base/rice_sequence.hpp"
 #include "encoders/base/ef_sequence.hpp"
 #include "encoders/pilotEncoders/interleaved_encoder.hpp"
 #include "encoders/pilotEncoders/interleaved_encoder_dual.hpp"
+#include "encoders/pilotEncoders/flat_interleaved_encoder.hpp"
 #include "encoders/base/encoders.hpp"
+#include "encoders/partitionOffsetEnocders/diff_partition_offset_encoder.hpp"
+#include "encoders/base/mappable_vector.hpp"
 #include "fastmod/fastmod.h"
 #include "hasher.hpp"
+#include "simd_query.hpp"
+#include "device_query_data.hpp"
 
 namespace phobicgpu {
 
 template <typename PilotEncoder, typename PartitionOffsetEncoder, typename Hasher>
 class MPHF {
 private:
-    std::vector<uint32_t> fulcs;
+    mappable_vector<uint32_t> fulcs;
 
     uint32_t partitions;
+    uint32_t partitionSize;
+    uint32_t bucketCountPerPartition;
     PilotEncoder pilots;
     PartitionOffsetEncoder partitionOffsets;
+    // Partitions built with a load factor below 1 hold more positions than keys, see MPHFconfig::setLoadFactor.
+    // remap maps the occupied positions from keyCount on to the free positions below, it is empty if every
+    // position is below keyCount or the function is not minimal.
+    uint64_t keyCount = 0;
+    ef_sequence<false> remap;
+
+    // fastmod constants indexed by partition size, derived from the partition offsets
+    std::vector<uint64_t> fastmodM;
+
+    // pilot columns of lookupBatchSimd, derived from the pilots. They point into the buffers of the encoder,
+    // so copying or moving a function rebuilds them for the buffers of the target.
+    std::vector<uint64_t> simdPilotBits;
+    std::vector<uint32_t> simdPilotWidths;
 
     inline uint32_t hash(uint32_t pilot, uint32_t key) const {
         key ^= pilot;
@@ -31,14 +54,27 @@ private:
 
     inline uint32_t hashPos(uint32_t pilot, uint32_t lower1, uint32_t lower2,
                             uint32_t partitionSize) const {
-        uint64_t M =
-            fastmod::computeM_u32(partitionSize);  // ToDo: cache M for all possibel partition sizes
+        uint64_t M = fastmodM[partitionSize];
         uint32_t hashPilot = fastmod::fastdiv_u32(pilot, M);
         uint32_t hashValue = hash(lower1, hash(lower2, hashPilot)) >> 1;
         uint32_t pos = fastmod::fastmod_u32(hashValue + pilot, M, partitionSize);
         return pos;
     }
 
+    void initFastmod() {
+        uint32_t maxPartitionSize = 0;
+        for (uint64_t partition = 0; partition < partitions; partition++) {
+            maxPartitionSize = std::max(maxPartitionSize, uint32_t(partitionOffsets.access(partition + 1) -
+                                                                   partitionOffsets.access(partition)));
+        }
+        fastmodM.resize(maxPartitionSize + 1);
+        // empty partitions are never queried
+        fastmodM[0] = 0;
+        for (uint32_t size = 1; size <= maxPartitionSize; size++) {
+            fastmodM[size] = fastmod::computeM_u32(size);
+        }
+    }
+
     inline uint64_t getBucket(uint64_t bucketBits) const {
         uint64_t z = bucketBits * uint64_t(FULCS_INTER - 1);
         uint64_t index = z >> 32;
@@ -48,7 +84,160 @@ private:
         return (v1 + v2) >> 16;
     }
 
+    inline uint64_t resolve(const Key& key, uint64_t partition, uint64_t bucket) const {
+        uint32_t pilot = pilots.access(partition, bucket);
+        uint64_t partitionOffset = partitionOffsets.access(partition);
+        uint32_t partitionSize = partitionOffsets.access(partition + 1) - partitionOffset;
+        return partitionOffset + hashPos(pilot, key.lower1, key.lower2, partitionSize);
+    }
+
+    // the two passes of lookup_batch over at most LOOKUP_WINDOW hashed keys
+    template <typename outType>
+    void resolveWindow(const Key* keys, size_t n, outType* out) const {
+        uint64_t windowPartitions[LOOKUP_WINDOW];
+        uint64_t windowBuckets[LOOKUP_WINDOW];
+        for (size_t i = 0; i < n; i++) {
+            uint64_t partition = (uint64_t(keys[i].partitioner) * uint64_t(partitions)) >> 32;
+            uint64_t bucket = getBucket(keys[i].bucketer);
+            pilots.prefetch(partition, bucket);
+            partitionOffsets.prefetch(partition);
+            windowPartitions[i] = partition;
+            windowBuckets[i] = bucket;
+        }
+        for (size_t i = 0; i < n; i++) {
+            out[i] = remapPosition(resolve(keys[i], windowPartitions[i], windowBuckets[i]));
+        }
+    }
+
+    // The fixed width encoders of FastQueryMphf can be decoded in SIMD lanes
+    constexpr static bool simdQuery() {
+#if defined(__AVX2__)
+        return (std::is_same_v<PilotEncoder, interleaved_encoder<compact>> ||
+                std::is_same_v<PilotEncoder, flat_interleaved_encoder<compact>>) &&
+               std::is_same_v<PartitionOffsetEncoder, diff_partition_encoder<compact>>;
+#else
+        return false;
+#endif
+    }
+
+    // called whenever the pilots change or move
+    void initSimdTables() {
+        if constexpr (simdQuery()) {
+            simdPilotBits.resize(pilots.num_buckets());
+            simdPilotWidths.resize(pilots.num_buckets());
+            for (size_t bucket = 0; bucket < pilots.num_buckets(); bucket++) {
+                if constexpr (std::is_same_v<PilotEncoder, flat_interleaved_encoder<compact>>) {
+                    auto column = pilots.bucket_column(bucket);
+                    simdPilotBits[bucket] = uint64_t(flat_column<compact>::bits(column, pilots.arena()));
+                    simdPilotWidths[bucket] = flat_column<compact>::width(column);
+                } else {
+                    const compact_vector& values = pilots.bucket_encoder(bucket).values();
+                    simdPilotBits[bucket] = uint64_t(values.bits().data());
+                    simdPilotWidths[bucket] = values.width();
+                }
+            }
+        }
+    }
+
+#if defined(__AVX2__)
+    template <typename keyType, typename outType>
+    void lookupBatchSimd(const keyType* keys, size_t n, outType* out) const {
+        static_assert(LOOKUP_WINDOW % simd::LANES == 0);
+        const compact_vector& offsets = partitionOffsets.base().base().values();
+        SimdQueryTables tables{fulcs.data(),
+                               partitions,
+                               simdPilotBits.data(),
+                               simdPilotWidths.data(),
+                               reinterpret_cast<const char*>(offsets.bits().data()),
+                               uint32_t(offsets.width()),
+                               uint32_t(partitionOffsets.base().get_increment())};
+
+        alignas(64) uint32_t partitioner[LOOKUP_WINDOW];
+        alignas(64) uint32_t bucketer[LOOKUP_WINDOW];
+        alignas(64) uint32_t lower1[LOOKUP_WINDOW];
+        alignas(64) uint32_t lower2[LOOKUP_WINDOW];
+        alignas(64) uint32_t windowPartitions[LOOKUP_WINDOW];
+        alignas(64) uint32_t windowBuckets[LOOKUP_WINDOW];
+        alignas(64) uint32_t windowOut[LOOKUP_WINDOW];
+        Key windowKeys[LOOKUP_WINDOW];
+        for (size_t begin = 0; begin < n; begin += LOOKUP_WINDOW) {
+            size_t windowSize = std::min(LOOKUP_WINDOW, n - begin);
+            initialHashBatch(keys + begin, windowSize, windowKeys);
+            for (size_t i = 0; i < LOOKUP_WINDOW; i++) {
+                // the last window is padded with keys that map to partition 0
+                Key key = i < windowSize ? windowKeys[i] : Key(0, 0, 0, 0);
+                partitioner[i] = key.partitioner;
+                bucketer[i] = key.bucketer;
+                lower1[i] = key.lower1;
+                lower2[i] = key.lower2;
+            }
+            for (size_t i = 0; i < LOOKUP_WINDOW; i += simd::LANES) {
+                simd::partitionsAndBuckets(tables, partitioner + i, bucketer + i, windowPartitions + i,
+                                           windowBuckets + i);
+            }
+            for (size_t i = 0; i < windowSize; i++) {
+                pilots.prefetch(windowPartitions[i], windowBuckets[i]);
+                partitionOffsets.prefetch(windowPartitions[i]);
+            }
+            for (size_t i = 0; i < LOOKUP_WINDOW; i += simd::LANES) {
+                simd::resolve(tables, windowPartitions + i, windowBuckets + i, lower1 + i, lower2 + i,
+                              windowOut + i);
+            }
+            if (remap.size() != 0) {
+                for (size_t i = 0; i < windowSize; i++) {
+                    windowOut[i] = uint32_t(remapPosition(windowOut[i]));
+                }
+            }
+            std::copy(windowOut, windowOut + windowSize, out + begin);
+        }
+    }
+#endif
+
 public:
+    // number of queries in flight in lookup_batch
+    static constexpr size_t LOOKUP_WINDOW = 32;
+
+    MPHF() = default;
+
+    MPHF(const MPHF& other) {
+        *this = other;
+    }
+
+    MPHF(MPHF&& other) {
+        *this = std::move(other);
+    }
+
+    MPHF& operator=(const MPHF& other) {
+        if (this == &other) return *this;
+        fulcs = other.fulcs;
+        partitions = other.partitions;
+        partitionSize = other.partitionSize;
+        bucketCountPerPartition = other.bucketCountPerPartition;
+        pilots = other.pilots;
+        partitionOffsets = other.partitionOffsets;
+        keyCount = other.keyCount;
+        remap = other.remap;
+        fastmodM = other.fastmodM;
+        initSimdTables();
+        return *this;
+    }
+
+    MPHF& operator=(MPHF&& other) {
+        if (this == &other) return *this;
+        fulcs = std::move(other.fulcs);
+        partitions = other.partitions;
+        partitionSize = other.partitionSize;
+        bucketCountPerPartition = other.bucketCountPerPartition;
+        pilots = std::move(other.pilots);
+        partitionOffsets = std::move(other.partitionOffsets);
+        keyCount = other.keyCount;
+        remap = std::move(other.remap);
+        fastmodM = std::move(other.fastmodM);
+        initSimdTables();
+        other.initSimdTables();
+        return *this;
+    }
+
     PilotEncoder& getPilotEncoder() {
         return pilots;
     }
@@ -57,43 +246,290 @@ public:
         return std::is_same_v<Hasher, nohash>;
     }
 
+    // whether MPHFbuilder can compute initialHash of keyType on the device
+    template <typename keyType>
+    constexpr static bool deviceHash() {
+        return std::is_same_v<Hasher, xxhash> &&
+               (std::is_same_v<keyType, std::string> || std::is_same_v<keyType, uint64_t>);
+    }
+
     template <typename keyType>
     static inline Key initialHash(const keyType& keyRaw) {
         return Hasher::hash(keyRaw);
     }
 
-    void setData(const std::vector<uint32_t>& pilots, std::vector<uint32_t>& partitionOffsets,
-                 uint32_t partitions, MPHFconfig config) {
-        fulcs = config.getFulcs();
-        this->partitions = partitions;
+    // initialHash of n keys, short string keys are hashed several at once
+    template <typename keyType>
+    static inline void initialHashBatch(const keyType* keysRaw, size_t n, Key* out) {
+        Hasher::hash_batch(keysRaw, n, out);
+    }
 
+    // partitionOffsets holds the partitions + 1 global key offsets, 64-bit for functions over more than 2^32 keys
+    template <typename offsetType>
+    void setData(const std::vector<uint32_t>& pilots, std::vector<offsetType>& partitionOffsets,
+                 uint32_t partitions, MPHFconfig config) {
 #pragma omp task
-        this->partitionOffsets.encode(partitionOffsets.begin(), config.partitionSize,
-                                      partitions + 1);
+        setPartitionOffsets(partitionOffsets, partitions, config);
         this->pilots.encode(pilots.begin(), partitions, config.bucketCountPerPartition);
 #pragma omp taskwait
+        initSimdTables();
+    }
+
+    // setData in two steps, such that the partition offsets can be encoded while the pilots are still computed
+    // or transferred. setPilots has to follow setPartitionOffsets.
+    template <typename offsetType>
+    void setPartitionOffsets(std::vector<offsetType>& partitionOffsets, uint32_t partitions, MPHFconfig config) {
+        fulcs = huge_page_vector<uint32_t>(config.getFulcs().begin(), config.getFulcs().end());
+        this->partitions = partitions;
+        partitionSize = config.partitionSize;
+        bucketCountPerPartition = config.bucketCountPerPartition;
+        keyCount = partitionOffsets[partitions];
+        remap = ef_sequence<false>();
+        if (config.slotsPerMille == 1000) {
+            this->partitionOffsets.encode(partitionOffsets.begin(), config.partitionSize,
+                                          partitions + 1);
+        } else {
+            // the queries take the offsets of the positions that the search used for each partition
+            std::vector<uint64_t> slotOffsets(size_t(partitions) + 1, 0);
+            for (uint64_t partition = 0; partition < partitions; partition++) {
+                slotOffsets[partition + 1] = slotOffsets[partition] +
+                        config.partitionSlots(uint32_t(partitionOffsets[partition + 1] - partitionOffsets[partition]));
+            }
+            this->partitionOffsets.encode(slotOffsets.begin(), config.partitionSlots(config.partitionSize),
+                                          partitions + 1);
+        }
+        initFastmod();
+    }
+
+    void setPilots(const std::vector<uint32_t>& pilots) {
+        this->pilots.encode(pilots.begin(), partitions, bucketCountPerPartition);
+        initSimdTables();
+    }
+
+    // Makes a function built with a load factor below 1 minimal again. occupancy holds a bitmap of the used
+    // positions of every partition, wordsPerPartition words each, as written by the search. The occupied
+    // positions from size() on are remapped to the free positions below size() in increasing order.
+    void setOccupancy(const std::vector<uint32_t>& occupancy, uint64_t wordsPerPartition) {
+        uint64_t n = keyCount;
+        uint64_t m = partitionOffsets.access(partitions);
+        remap = ef_sequence<false>();
+        if (m == n) {
+            return;
+        }
+        if (fastmodM.size() - 1 > 32 * wordsPerPartition) {
+            throw std::runtime_error("occupancy bitmap is smaller than the partitions");
+        }
+        auto occupied = [&](uint64_t partition, uint64_t slot) {
+            return (occupancy[partition * wordsPerPartition + slot / 32] >> (slot % 32)) & 1;
+        };
+
+        // the free positions below n, counted and gathered per partition
+        std::vector<uint64_t> freeBegin(size_t(partitions) + 1, 0);
+#pragma omp parallel for
+        for (uint64_t partition = 0; partition < partitions; partition++) {
+            uint64_t begin = partitionOffsets.access(partition);
+            uint64_t end = std::min(partitionOffsets.access(partition + 1), n);
+            uint64_t free = 0;
+            for (uint64_t slot = 0; begin + slot < end; slot++) {
+                free += !occupied(partition, slot);
+            }
+            freeBegin[partition + 1] = free;
+        }
+        for (uint64_t partition = 0; partition < partitions; partition++) {
+            freeBegin[partition + 1] += freeBegin[partition];
+        }
+        std::vector<uint64_t> freePositions(freeBegin[partitions]);
+#pragma omp parallel for
+        for (uint64_t partition = 0; partition < partitions; partition++) {
+            uint64_t begin = partitionOffsets.access(partition);
+            uint64_t end = std::min(partitionOffsets.access(partition + 1), n);
+            uint64_t next = freeBegin[partition];
+            for (uint64_t slot = 0; begin + slot < end; slot++) {
+                if (!occupied(partition, slot)) {
+                    freePositions[next++] = begin + slot;
+                }
+            }
+        }
+
+        // unoccupied positions repeat the previous value, such that the sequence stays monotone for Elias-Fano
+        std::vector<uint64_t> values(m - n);
+        uint64_t next = 0;
+        uint64_t last = 0;
+        for (uint64_t partition = 0; partition < partitions; partition++) {
+            uint64_t begin = partitionOffsets.access(partition);
+            uint64_t end = partitionOffsets.access(partition + 1);
+            for (uint64_t position = std::max(begin, n); position < end; position++) {
+                if (occupied(partition, position - begin)) {
+                    last = freePositions[next++];
+                }
+                values[position - n] = last;
+            }
+        }
+        if (next != freePositions.size()) {
+            throw std::runtime_error("occupancy does not match the number of keys");
+        }
+        remap.encode(values.begin(), values.size());
     }
 
     template <typename keyType>
-    inline uint32_t operator()(const keyType& keyRaw) const {
-        Key key = initialHash(keyRaw);
+    inline uint64_t operator()(const keyType& keyRaw) const {
+        return lookup_hashed(initialHash(keyRaw));
+    }
+
+    // operator() for a key that is already hashed with initialHash, e.g., to derive further bits from the Key
+    inline uint64_t lookup_hashed(const Key& key) const {
         uint64_t partition = (uint64_t(key.partitioner) * uint64_t(partitions)) >> 32;
         uint64_t bucket = getBucket(key.bucketer);
-        uint32_t pilot = pilots.access(partition, bucket);
-        uint32_t partitionOffset = partitionOffsets.access(partition);
-        uint32_t partitionSize = partitionOffsets.access(partition + 1) - partitionOffset;
-        return partitionOffset + hashPos(pilot, key.lower1, key.lower2, partitionSize);
+        return remapPosition(resolve(key, partition, bucket));
+    }
+
+    // the final position of a position of the partitions, which differ only for positions from size() on of a
+    // function built with a load factor below 1, see setOccupancy
+    inline uint64_t remapPosition(uint64_t position) const {
+        return position < keyCount || remap.size() == 0 ? position : remap.access(position - keyCount);
+    }
+
+    // Evaluates the function for n keys. Keys are processed in windows: the first pass hashes the window and
+    // prefetches the pilots and partition offsets, the second pass resolves the positions. This overlaps the
+    // cache misses of independent queries instead of paying them one after another. out may hold uint32_t
+    // values if the function has at most 2^32 keys.
+    template <typename keyType, typename outType>
+    void lookup_batch(const keyType* keys, size_t n, outType* out) const {
+#if defined(__AVX2__)
+        // the SIMD lanes compute the partition offsets with 32 bits
+        if constexpr (simdQuery()) {
+            if (partitionOffsets.access(partitions) <= std::numeric_limits<uint32_t>::max()) {
+                lookupBatchSimd(keys, n, out);
+                return;
+            }
+        }
+#endif
+        Key windowKeys[LOOKUP_WINDOW];
+        for (size_t begin = 0; begin < n; begin += LOOKUP_WINDOW) {
+            size_t windowSize = std::min(LOOKUP_WINDOW, n - begin);
+            initialHashBatch(keys + begin, windowSize, windowKeys);
+            resolveWindow(windowKeys, windowSize, out + begin);
+        }
+    }
+
+    // lookup_batch for keys that are already hashed with initialHash
+    template <typename outType>
+    void lookup_hashed_batch(const Key* keys, size_t n, outType* out) const {
+        for (size_t begin = 0; begin < n; begin += LOOKUP_WINDOW) {
+            resolveWindow(keys + begin, std::min(LOOKUP_WINDOW, n - begin), out + begin);
+        }
+    }
+
+    // number of keys
+    uint64_t size() const {
+        return keyCount;
+    }
+
+    // number of positions the function maps to, larger than size() only if it was built with a load factor
+    // below 1 and without remapping
+    uint64_t range() const {
+        return remap.size() != 0 ? keyCount : partitionOffsets.access(partitions);
     }
 
     float getBitsPerKey() const {
-        return float(pilots.num_bits() + partitionOffsets.num_bits() + 32 * fulcs.size() + 32 * partitions) /
-               float(partitionOffsets.access(partitions));
+        return float(pilots.num_bits() + partitionOffsets.num_bits() + remap.num_bits() + 32 * fulcs.size() +
+                     32 * partitions + 64 * fastmodM.size()) /
+               float(size());
+    }
+
+    // The data read by QueryStage, such that the function can be evaluated on the device, see DeviceMPHF. The
+    // pilots are re-encoded from any PilotEncoder, the device computes the positions with 32 bits.
+    void getDeviceQueryData(DeviceQueryData& data) const {
+        if (partitionOffsets.access(partitions) > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("device queries require at most 2^32 positions");
+        }
+        data.partitions = partitions;
+        data.bucketCountPerPartition = bucketCountPerPartition;
+        data.fulcs.assign(fulcs.begin(), fulcs.end());
+        data.partitionOffsets.resize(size_t(partitions) + 1);
+        for (uint64_t partition = 0; partition <= partitions; partition++) {
+            data.partitionOffsets[partition] = uint32_t(partitionOffsets.access(partition));
+        }
+        data.keyCount = remap.size() != 0 ? uint32_t(keyCount) : std::numeric_limits<uint32_t>::max();
+        data.remap.resize(remap.size());
+#pragma omp parallel for
+        for (uint64_t i = 0; i < remap.size(); i++) {
+            data.remap[i] = uint32_t(remap.access(i));
+        }
+
+        uint64_t buckets = bucketCountPerPartition;
+        std::vector<uint64_t> widths(buckets);
+#pragma omp parallel for
+        for (uint64_t bucket = 0; bucket < buckets; bucket++) {
+            uint64_t max = 0;
+            for (uint64_t partition = 0; partition < partitions; partition++) {
+                max = std::max<uint64_t>(max, pilots.access(partition, bucket));
+            }
+            widths[bucket] = max == 0 ? 0 : util::msb(max) + 1;
+        }
+        data.pilotColumns.resize(2 * buckets);
+        uint64_t words = 0;
+        for (uint64_t bucket = 0; bucket < buckets; bucket++) {
+            data.pilotColumns[2 * bucket] = uint32_t(words);
+            data.pilotColumns[2 * bucket + 1] = uint32_t(widths[bucket]);
+            words += (partitions * widths[bucket] + 31) / 32;
+        }
+        if (words > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("device queries require at most 2^32 words of pilots");
+        }
+        data.pilotBits.assign(words, 0);
+#pragma omp parallel for
+        for (uint64_t bucket = 0; bucket < buckets; bucket++) {
+            uint32_t* column = data.pilotBits.data() + data.pilotColumns[2 * bucket];
+            uint64_t width = widths[bucket];
+            for (uint64_t partition = 0, pos = 0; width != 0 && partition < partitions; partition++, pos += width) {
+                uint64_t pilot = pilots.access(partition, bucket);
+                column[pos / 32] |= uint32_t(pilot << (pos % 32));
+                if (pos % 32 + width > 32) {
+                    column[pos / 32 + 1] |= uint32_t(pilot >> (32 - pos % 32));
+                }
+            }
+        }
+    }
+
+    // type tag stored in serialized functions
+    std::string name() const {
+        return "MPHF<" + pilots.name() + "," + PartitionOffsetEncoder::name() + "," + Hasher::name() + ">";
+    }
+
+    template <typename Visitor>
+    void visit(Visitor& visitor) {
+        visitor.visit(partitions);
+        visitor.visit(partitionSize);
+        visitor.visit(bucketCountPerPartition);
+        visitor.visit(fulcs);
+        visitor.visit(pilots);
+        visitor.visit(partitionOffsets);
+        visitor.visit(keyCount);
+        visitor.visit(remap);
+        // the queries index the fulcrums and partition offsets without bounds checks
+        if (fulcs.size() != FULCS_INTER || partitionOffsets.size() < uint64_t(partitions) + 1) {
+            throw std::runtime_error("inconsistent MPHF data");
+        }
+        // initFastmod allocates a constant per partition size, which is at most the positions of a partition of
+        // MPHFconfig::partitionMaxSize keys at the smallest load factor of 1/2, see MPHFconfig::partitionMaxSlots
+        uint64_t maxSlots = (2 * (uint64_t(partitionSize) + partitionSize / 2) + 31) / 32 * 32;
+        for (uint64_t partition = 0; partition < partitions; partition++) {
+            uint64_t begin = partitionOffsets.access(partition);
+            uint64_t end = partitionOffsets.access(partition + 1);
+            if (end < begin || end - begin > maxSlots) {
+                throw std::runtime_error("inconsistent MPHF partition offsets");
+            }
+        }
+        initFastmod();
+        initSimdTables();
     }
 
     std::string getResultLine() {
-        double n = float(partitionOffsets.access(partitions));
+        double n = double(size());
         return "total_bits=" + std::to_string(getBitsPerKey()) + " pilot_bits=" + std::to_string(pilots.num_bits() / n) +
-               " offsets_bits=" + std::to_string(partitionOffsets.num_bits() / n);
+               " offsets_bits=" + std::to_string(partitionOffsets.num_bits() / n) +
+               " remap_bits=" + std::to_string(remap.num_bits() / n);
     }
 };
 
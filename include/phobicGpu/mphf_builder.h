@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
 #include "app/app.h"
 #include "app/host_timer.h"
 #include "app/utils.h"
@@ -8,6 +13,8 @@
 #include "prefix_sum_stage.h"
 #include "redistribute_keys_stage.h"
 #include "apply_partition_offset.h"
+#include "initial_hash_stage.h"
+#include "query_stage.h"
 #include "mphf_config.h"
 #include "search_stage.h"
 #include "mphf.hpp"
@@ -21,6 +28,8 @@ namespace phobicgpu {
         friend
         class BuildInvocation;
 
+        friend class BuildSession;
+
     private:
         MPHFconfig config;
         App &app;
@@ -31,6 +40,13 @@ namespace phobicgpu {
         SearchStage searchStage;
         PrefixSumStage partitionOffsetPPSStage;
         PartitionOffsetStage applyPartitionOffsetStage;
+        InitialHashStage initialHashStage;
+        QueryStage queryStage;
+
+        size_t transferChunkSize = 0;
+        bool deviceHashing = false;
+        Trace *trace = nullptr;
+        std::vector<uint32_t> *positions = nullptr;
 
     public:
         MPHFbuilder(MPHFconfig config = MPHFconfig()) :
@@ -42,26 +58,69 @@ namespace phobicgpu {
                 searchStage(SearchStage(app, app.subGroupSize, config)),
                 partitionOffsetPPSStage(PrefixSumStage(app, app.subGroupSize, app.subGroupSize)),
                 applyPartitionOffsetStage(
-                        PartitionOffsetStage(app, app.subGroupSize, config.bucketCountPerPartition)) {}
+                        PartitionOffsetStage(app, app.subGroupSize, config.bucketCountPerPartition)),
+                initialHashStage(InitialHashStage(app, app.subGroupSize)),
+                queryStage(QueryStage(app, app.subGroupSize)) {}
+
+        // The keys are always hashed into the staging ring in chunks, chunk i + 1 while chunk i is copied on the
+        // transfer queue. A chunk size of chunkSize keys additionally reads the partition offsets back and encodes
+        // them while the search is still running. 0 uses chunks of 8 MiB and reads the offsets back at the end.
+        void setTransferChunkSize(size_t chunkSize) {
+            transferChunkSize = chunkSize;
+        }
+
+        // Computes the initial xxhash of std::string and uint64_t keys on the device, such that the host only packs
+        // the raw keys. Ignored without 64-bit integer support in shaders, which keeps hashing on the host.
+        void setDeviceHashing(bool enabled) {
+            deviceHashing = enabled;
+        }
+
+        // Records the host phases, compute stages and staging transfers of the following builds into trace,
+        // e.g. to export them with trace->writeJson(). nullptr stops recording.
+        void setTrace(Trace *trace) {
+            this->trace = trace;
+        }
+
+        // The following builds store f(keys[i]) in (*positions)[i], e.g., to place values aligned to the function
+        // without evaluating it on the host. The device evaluates the keys right after the search, from the pilots
+        // before they are encoded. nullptr stops the output.
+        void setPositionOutput(std::vector<uint32_t> *positions) {
+            this->positions = positions;
+        }
 
+        // partitions = 0 derives the number of partitions from the number of keys
         template<typename Mphf, typename keyType>
-        HostTimer build(const std::vector<keyType> &keys, Mphf &f);
+        HostTimer build(const std::vector<keyType> &keys, Mphf &f, uint32_t partitions = 0);
     };
 
-    template<typename Mphf, typename keyType>
-    class BuildInvocation {
-        Mphf &f;
-        const std::vector<keyType> &keysRaw;
-        std::vector<Key> keys;
-        uint32_t size;
-        uint32_t partitions;
+    // Device buffers, descriptor sets and the recorded command buffer of consecutive builds with one MPHFbuilder.
+    // The buffers grow to the largest build so far. A build with the same number of keys and partitions as the
+    // previous one submits the recorded command buffer again, other builds re-record it with the same descriptor
+    // pools. Functions of similar size can be rebuilt without allocations this way.
+    class BuildSession {
+        template<typename Mphf, typename keyType>
+        friend
+        class BuildInvocation;
+
+    private:
+        MPHFbuilder &builder;
         MPHFconfig config;
         App &app;
-        MPHFbuilder *builder;
-
-        CommandBuffer *cb;
-        uint32_t totalBucketCount;
 
+        // number of keys and partitions the buffers are sized for
+        uint32_t keyCapacity = 0;
+        uint32_t partitionCapacity = 0;
+
+        // parameters of the recorded commands
+        CommandBuffer *cb = nullptr;
+        // the commands after the partition offsets, submitted after cb such that the host can wait for the
+        // partition offsets with the fence of cb
+        CommandBuffer *tailCb = nullptr;
+        bool recorded = false;
+        uint32_t size = 0;
+        uint32_t partitions = 0;
+        bool pipelined = false;
+        bool positions = false;
 
         BufferAllocation debugBuffer;
 
@@ -80,19 +139,33 @@ namespace phobicgpu {
         BufferAllocation pilotsHost;
         BufferAllocation fulcrums;
 
-        PrefixSumData ppsData;
+        // occupied positions of the search, only allocated for a remapped load factor below 1
+        BufferAllocation occupancyDevice;
+        BufferAllocation occupancyHost;
 
-    public:
-        BuildInvocation(Mphf &f, const std::vector<keyType> &keysRaw, uint32_t size, MPHFconfig config, App &app,
-                        MPHFbuilder *builder) : f(f), keysRaw(keysRaw), size(size), config(config), app(app),
-                                                builder(builder) {
-            size = keysRaw.size();
-            partitions = (size + config.partitionSize - 1) / config.partitionSize;
-            totalBucketCount = partitions * config.bucketCountPerPartition;
-        }
+        // query data of the unencoded pilots, only allocated for builds with a position output
+        uint32_t positionCapacity = 0;
+        BufferAllocation positionsDevice;
+        BufferAllocation partitionBounds;
+        BufferAllocation pilotColumns;
+        // evaluates the keys once the host knows the partition bounds, for a load factor below 1
+        CommandBuffer *positionsCb = nullptr;
 
+        PrefixSumData ppsData;
+
+        // batches of raw keys hashed on the device, double buffered such that the host packs the next batch
+        // while the device hashes the previous one
+        BufferAllocation rawKeys[2];
+        BufferAllocation rawOffsets[2];
+        CommandBuffer *hashCb[2] = {nullptr, nullptr};
+        bool hashPending[2] = {false, false};
+        size_t rawCapacity = 0;
 
         void allocateBuffers() {
+            uint32_t size = keyCapacity;
+            uint32_t partitions = partitionCapacity;
+            uint32_t totalBucketCount = partitions * config.bucketCountPerPartition;
+
             debugBuffer = app.memoryAlloc.createDeviceLocalBuffer(sizeof(uint32_t) * config.sortingBins,
                                                                   vk::BufferUsageFlagBits::eTransferSrc);
 
@@ -110,6 +183,7 @@ namespace phobicgpu {
             bucketSizeHistogram = app.memoryAlloc.createDeviceLocalBuffer(
                     sizeof(uint32_t) * config.sortingBins * partitions, vk::BufferUsageFlagBits::eTransferSrc);
             bucketSizes = app.memoryAlloc.createDeviceLocalBuffer(sizeof(uint32_t) * totalBucketCount,
+                                                                  vk::BufferUsageFlagBits::eTransferDst |
                                                                   vk::BufferUsageFlagBits::eTransferSrc);
             partitionsSizes = app.memoryAlloc.createDeviceLocalBuffer(sizeof(uint32_t) * partitions,
                                                                       vk::BufferUsageFlagBits::eTransferSrc);
@@ -126,32 +200,207 @@ namespace phobicgpu {
                                                                  sizeof(uint32_t) * partitions);
 
             pilotsDevice = app.memoryAlloc.createDeviceLocalBuffer(sizeof(uint32_t) * totalBucketCount,
+                                                                   vk::BufferUsageFlagBits::eTransferDst |
                                                                    vk::BufferUsageFlagBits::eTransferSrc);
             pilotsHost = app.memoryAlloc.createBuffer(vk::BufferUsageFlagBits::eTransferDst,
                                                       vk::MemoryPropertyFlagBits::eHostVisible |
                                                       vk::MemoryPropertyFlagBits::eHostCached |
                                                       vk::MemoryPropertyFlagBits::eHostCoherent,
                                                       sizeof(uint32_t) * totalBucketCount);
+
+            if (config.remapped()) {
+                size_t occupancyBytes = sizeof(uint32_t) * SearchStage::occupancyWords(config) * partitions;
+                occupancyDevice = app.memoryAlloc.createDeviceLocalBuffer(occupancyBytes,
+                                                                          vk::BufferUsageFlagBits::eTransferSrc);
+                occupancyHost = app.memoryAlloc.createBuffer(vk::BufferUsageFlagBits::eTransferDst,
+                                                             vk::MemoryPropertyFlagBits::eHostVisible |
+                                                             vk::MemoryPropertyFlagBits::eHostCached |
+                                                             vk::MemoryPropertyFlagBits::eHostCoherent,
+                                                             occupancyBytes);
+            }
+
+            // the fulcrums only depend on the configuration
+            app.memoryAlloc.upload(fulcrums, config.getFulcs().data(), sizeof(uint32_t) * config.getFulcs().size());
+        }
+
+        void freeBuffers() {
+            partitionsSizes.free(app.memoryAlloc);
+            partitionsOffsetsDevice.free(app.memoryAlloc);
+            partitionsOffsetsHost.free(app.memoryAlloc);
+            bucketSizeHistogram.free(app.memoryAlloc);
+            debugBuffer.free(app.memoryAlloc);
+            keysSrc.free(app.memoryAlloc);
+            keysLowerDst.free(app.memoryAlloc);
+            keyOffsets.free(app.memoryAlloc);
+            bucketSizes.free(app.memoryAlloc);
+            bucketPermuatation.free(app.memoryAlloc);
+            pilotsDevice.free(app.memoryAlloc);
+            pilotsHost.free(app.memoryAlloc);
+            fulcrums.free(app.memoryAlloc);
+            if (config.remapped()) {
+                occupancyDevice.free(app.memoryAlloc);
+                occupancyHost.free(app.memoryAlloc);
+            }
+        }
+
+        // grows the buffers to the given number of keys and partitions, which invalidates the recorded commands
+        void reserve(uint32_t size, uint32_t partitions) {
+            if (size <= keyCapacity && partitions <= partitionCapacity && keyCapacity != 0) {
+                return;
+            }
+            if (keyCapacity != 0) {
+                freeBuffers();
+            }
+            if (positionCapacity != 0) {
+                // the partition bounds are sized for the previous partitions
+                freePositions();
+            }
+            keyCapacity = std::max(keyCapacity, std::max(size, 1u));
+            partitionCapacity = std::max(partitionCapacity, std::max(partitions, 1u));
+            allocateBuffers();
+            recorded = false;
+        }
+
+        void freePositions() {
+            positionsDevice.free(app.memoryAlloc);
+            partitionBounds.free(app.memoryAlloc);
+            pilotColumns.free(app.memoryAlloc);
+            positionCapacity = 0;
+        }
+
+        // grows the buffers of the position output, which invalidates the recorded commands
+        void reservePositions() {
+            if (keyCapacity <= positionCapacity) {
+                return;
+            }
+            if (positionCapacity != 0) {
+                freePositions();
+            }
+            positionCapacity = keyCapacity;
+            positionsDevice = app.memoryAlloc.createDeviceLocalBuffer(sizeof(uint32_t) * positionCapacity,
+                                                                      vk::BufferUsageFlagBits::eTransferSrc);
+            partitionBounds = app.memoryAlloc.createDeviceLocalBuffer(sizeof(uint32_t) * (partitionCapacity + 1),
+                                                                      vk::BufferUsageFlagBits::eTransferDst);
+            pilotColumns = app.memoryAlloc.createDeviceLocalBuffer(
+                    sizeof(uint32_t) * 2 * config.bucketCountPerPartition, vk::BufferUsageFlagBits::eTransferDst);
+            recorded = false;
+        }
+
+        void waitHashing(uint32_t buffer) {
+            if (hashPending[buffer]) {
+                hashCb[buffer]->wait(app.device);
+                hashPending[buffer] = false;
+            }
+        }
+
+        void freeRaw() {
+            for (uint32_t i = 0; i < 2; i++) {
+                waitHashing(i);
+                rawKeys[i].free(app.memoryAlloc);
+                rawOffsets[i].free(app.memoryAlloc);
+            }
+            rawCapacity = 0;
+        }
+
+        // grows both raw key buffers to bytes, the offsets always have room for a batch of keys
+        void reserveRaw(size_t bytes, uint32_t batchKeys) {
+            if (bytes <= rawCapacity) {
+                return;
+            }
+            if (rawCapacity != 0) {
+                freeRaw();
+            }
+            rawCapacity = bytes;
+            for (uint32_t i = 0; i < 2; i++) {
+                rawKeys[i] = app.memoryAlloc.createDeviceLocalBuffer(rawCapacity, vk::BufferUsageFlagBits::eTransferDst);
+                rawOffsets[i] = app.memoryAlloc.createDeviceLocalBuffer(sizeof(uint32_t) * (batchKeys + 1),
+                                                                        vk::BufferUsageFlagBits::eTransferDst);
+            }
+        }
+
+        // hashes the raw keys of a batch that were uploaded to buffer into keysSrc starting at firstKey
+        void submitHashing(uint32_t buffer, uint32_t firstKey, uint32_t count, bool stringKeys) {
+            CommandBuffer *&hcb = hashCb[buffer];
+            if (hcb == nullptr) {
+                hcb = app.createCommandBuffer();
+            } else {
+                hcb->descrAlloc.reset();
+            }
+            hcb->begin();
+            builder.initialHashStage.addCommands(hcb, {count, firstKey}, stringKeys, rawKeys[buffer].buffer,
+                                                 rawOffsets[buffer].buffer, keysSrc.buffer);
+            hcb->submit(app.device, app.computeQueue, false);
+            hashPending[buffer] = true;
+        }
+
+        // records the commands unless they are recorded for the same parameters already, returns whether
+        // the recorded commands are reused
+        bool prepareCommands(uint32_t size, uint32_t partitions, bool pipelined, bool positions) {
+            if (recorded && this->size == size && this->partitions == partitions && this->pipelined == pipelined &&
+                this->positions == positions) {
+                return true;
+            }
+            if (cb == nullptr) {
+                cb = app.createCommandBuffer();
+                tailCb = app.createCommandBuffer();
+            } else {
+                // the descriptor sets and prefix sum buffers of the last recording are no longer used
+                cb->descrAlloc.reset();
+                tailCb->descrAlloc.reset();
+                ppsData.destroy(app.memoryAlloc);
+            }
+            this->size = size;
+            this->partitions = partitions;
+            this->pipelined = pipelined;
+            this->positions = positions;
+            if (positions) {
+                uploadPilotColumns();
+            }
+            addGpuCommands();
+            recorded = true;
+            return false;
+        }
+
+        // The pilots of the search are bucket-major, bucket b is a column of 32-bit pilots at word b * partitions.
+        // The query stage reads them with these columns without re-encoding them, see DeviceQueryData.
+        void uploadPilotColumns() {
+            std::vector<uint32_t> columns(2 * config.bucketCountPerPartition);
+            for (uint32_t bucket = 0; bucket < config.bucketCountPerPartition; bucket++) {
+                columns[2 * bucket] = bucket * partitions;
+                columns[2 * bucket + 1] = 32;
+            }
+            app.memoryAlloc.upload(pilotColumns, columns.data(), sizeof(uint32_t) * columns.size());
         }
 
         void addGpuCommands() {
+            uint32_t totalBucketCount = partitions * config.bucketCountPerPartition;
             TimestampCreateInfo createInfo;
             TimestampHandle beginTS = createInfo.addTimestamp({""});
             TimestampHandle bucketSizesTS = createInfo.addTimestamp({"bucket_sizes"});
             TimestampHandle bucketSortingTS = createInfo.addTimestamp({"bucket_sorting"});
             TimestampHandle partitionOffsetsTS = createInfo.addTimestamp({"partition_offsets"});
-            TimestampHandle partitionOffsetsApplyTS = createInfo.addTimestamp({"apply_partition_offsets"});
-            TimestampHandle keyRedistributeTS = createInfo.addTimestamp({"key_redistribution"});
-            TimestampHandle searchTS = createInfo.addTimestamp({"search"});
-            TimestampHandle copyTS = createInfo.addTimestamp({"memory_map"});
+            TimestampCreateInfo tailInfo;
+            TimestampHandle partitionOffsetsApplyTS = tailInfo.addTimestamp({"apply_partition_offsets"});
+            TimestampHandle keyRedistributeTS = tailInfo.addTimestamp({"key_redistribution"});
+            TimestampHandle searchTS = tailInfo.addTimestamp({"search"});
+            TimestampHandle copyTS = tailInfo.addTimestamp({"memory_map"});
+            TimestampHandle positionsTS;
+            if (positions && config.slotsPerMille == 1000) {
+                positionsTS = tailInfo.addTimestamp({"positions"});
+            }
 
             cb->attachTimestamps(app.device, createInfo);
+            tailCb->attachTimestamps(app.device, tailInfo);
 
-            cb->begin();
+            cb->begin(true);
             cb->writeTimeStamp(beginTS);
 
+            // the bucket sizes are counted atomically, suballocated memory may hold data of earlier buffers
+            cb->fillBuffer(bucketSizes.buffer, sizeof(uint32_t) * totalBucketCount, 0);
+            cb->transferComputeBarrier();
+
             // find the actual bucket sizes an store the local bucket offset of each key
-            builder->bucketSizesStage.addCommands(cb, {size, partitions, config.bucketCountPerPartition},
+            builder.bucketSizesStage.addCommands(cb, {size, partitions, config.bucketCountPerPartition},
                                                   keysSrc.buffer,
                                                   keyOffsets.buffer, bucketSizes.buffer, debugBuffer.buffer,
                                                   fulcrums.buffer);
@@ -160,7 +409,7 @@ namespace phobicgpu {
 
 
             // sort the buckets by descending size and determine bucket offsets
-            builder->bucketSortStage.addCommands(cb, {config.partitionMaxSize()}, bucketSizes.buffer, partitions,
+            builder.bucketSortStage.addCommands(cb, {config.partitionMaxSize()}, bucketSizes.buffer, partitions,
                                                  debugBuffer.buffer, bucketSizeHistogram.buffer, partitionsSizes.buffer,
                                                  bucketPermuatation.buffer);
             cb->writeTimeStamp(bucketSortingTS);
@@ -168,53 +417,290 @@ namespace phobicgpu {
 
             // partition offset calculations
             cb->copyBuffer(partitionsSizes.buffer, partitionsOffsetsDevice.buffer, sizeof(uint32_t) * partitions);
-            cb->readWritePipelineBarrier();
-            builder->partitionOffsetPPSStage.addCommands(cb, partitions, partitionsOffsetsDevice.buffer, ppsData);
+            cb->transferComputeBarrier();
+            builder.partitionOffsetPPSStage.addCommands(cb, partitions, partitionsOffsetsDevice.buffer, ppsData);
             cb->writeTimeStamp(partitionOffsetsTS);
             cb->readWritePipelineBarrier();
+            if (pipelined) {
+                // the host encodes the partition offsets while the remaining stages run
+                cb->copyBuffer(partitionsOffsetsDevice.buffer, partitionsOffsetsHost.buffer,
+                               sizeof(uint32_t) * partitions);
+                cb->transferHostBarrier();
+            }
+
+            // the pipeline barrier after the prefix sum orders the following submission as well
+            tailCb->begin(true);
 
             // apply the partition offsets to the bucket offsets
-            builder->applyPartitionOffsetStage.addCommands(cb, partitions, bucketSizes.buffer,
+            builder.applyPartitionOffsetStage.addCommands(tailCb, partitions, bucketSizes.buffer,
                                                            partitionsOffsetsDevice.buffer);
-            cb->writeTimeStamp(partitionOffsetsApplyTS);
-            cb->readWritePipelineBarrier();
+            tailCb->writeTimeStamp(partitionOffsetsApplyTS);
+            tailCb->readWritePipelineBarrier();
 
             // redistribute the keys such that the next step can read them in a coalesced manner
-            builder->redistributeKeysStage.addCommands(cb, {size, partitions, config.bucketCountPerPartition},
+            builder.redistributeKeysStage.addCommands(tailCb, {size, partitions, config.bucketCountPerPartition},
                                                        keysSrc.buffer, keysLowerDst.buffer, bucketSizes.buffer,
                                                        keyOffsets.buffer, fulcrums.buffer);
-            cb->writeTimeStamp(keyRedistributeTS);
-            cb->readWritePipelineBarrier();
+            tailCb->writeTimeStamp(keyRedistributeTS);
+            tailCb->readWritePipelineBarrier();
 
-            // perform the actual bijection searching
-            builder->searchStage.addCommands(cb, partitions, keysLowerDst.buffer, bucketSizeHistogram.buffer,
+            // perform the actual bijection searching, empty buckets are never written and get a zero pilot
+            tailCb->fillBuffer(pilotsDevice.buffer, sizeof(uint32_t) * totalBucketCount, 0);
+            tailCb->transferComputeBarrier();
+            builder.searchStage.addCommands(tailCb, partitions, keysLowerDst.buffer, bucketSizeHistogram.buffer,
                                              partitionsSizes.buffer, bucketPermuatation.buffer, pilotsDevice.buffer,
-                                             partitionsOffsetsDevice.buffer, debugBuffer.buffer);
-            cb->writeTimeStamp(searchTS);
-            cb->readWritePipelineBarrier();
+                                             partitionsOffsetsDevice.buffer, debugBuffer.buffer,
+                                             config.remapped() ? occupancyDevice.buffer : debugBuffer.buffer);
+            tailCb->writeTimeStamp(searchTS);
+            tailCb->readWritePipelineBarrier();
+
+            tailCb->copyBuffer(pilotsDevice.buffer, pilotsHost.buffer, sizeof(uint32_t) * totalBucketCount);
+            if (!pipelined) {
+                tailCb->copyBuffer(partitionsOffsetsDevice.buffer, partitionsOffsetsHost.buffer,
+                                   sizeof(uint32_t) * partitions);
+            }
+            if (config.remapped()) {
+                tailCb->copyBuffer(occupancyDevice.buffer, occupancyHost.buffer,
+                                   sizeof(uint32_t) * SearchStage::occupancyWords(config) * partitions);
+            }
+            tailCb->writeTimeStamp(copyTS);
+
+            // with a load factor below 1, the partitions have more positions than keys and the bounds are
+            // computed on the host, see submitPositions
+            if (positions && config.slotsPerMille == 1000) {
+                // the device offsets are the inclusive prefix sums, the query reads partitions + 1 bounds
+                tailCb->fillBuffer(partitionBounds.buffer, sizeof(uint32_t), 0);
+                tailCb->copyBuffer(partitionsOffsetsDevice.buffer, partitionBounds.buffer,
+                                   sizeof(uint32_t) * partitions, 0, sizeof(uint32_t));
+                tailCb->transferComputeBarrier();
+                // the hashed keys are still in keysSrc in input order
+                builder.queryStage.addCommands(tailCb, {size, partitions, config.bucketCountPerPartition,
+                                                    std::numeric_limits<uint32_t>::max()},
+                                               keysSrc.buffer, partitionBounds.buffer, pilotColumns.buffer,
+                                               pilotsDevice.buffer, debugBuffer.buffer, positionsDevice.buffer,
+                                               fulcrums.buffer);
+                tailCb->writeTimeStamp(positionsTS);
+            }
+        }
 
-            cb->copyBuffer(pilotsDevice.buffer, pilotsHost.buffer, sizeof(uint32_t) * totalBucketCount);
-            cb->copyBuffer(partitionsOffsetsDevice.buffer, partitionsOffsetsHost.buffer, sizeof(uint32_t) * partitions);
-            cb->writeTimeStamp(copyTS);
+        // Evaluates the keys of the last build into positionsDevice for partitions with more positions than
+        // keys, once the host has computed the partitions + 1 bounds of their positions. The positions are the
+        // ones before remapping.
+        void submitPositions(const std::vector<uint32_t> &bounds) {
+            app.memoryAlloc.upload(partitionBounds, bounds.data(), sizeof(uint32_t) * bounds.size());
+            if (positionsCb == nullptr) {
+                positionsCb = app.createCommandBuffer();
+            } else {
+                positionsCb->descrAlloc.reset();
+            }
+            positionsCb->begin();
+            builder.queryStage.addCommands(positionsCb, {size, partitions, config.bucketCountPerPartition,
+                                                         std::numeric_limits<uint32_t>::max()},
+                                           keysSrc.buffer, partitionBounds.buffer, pilotColumns.buffer,
+                                           pilotsDevice.buffer, debugBuffer.buffer, positionsDevice.buffer,
+                                           fulcrums.buffer);
+            positionsCb->submit(app.device, app.computeQueue, true);
         }
 
-        const std::vector<Key> &initialHash() {
-            if constexpr (Mphf::noHash()) {
-                if constexpr(std::is_same_v<Key, keyType>) {
-                    return keysRaw;
-                } else {
-                    exit(1); // should be unreachable
+    public:
+        BuildSession(MPHFbuilder &builder) : builder(builder), config(builder.config), app(builder.app) {}
+
+        BuildSession(const BuildSession &) = delete;
+
+        BuildSession &operator=(const BuildSession &) = delete;
+
+        ~BuildSession() {
+            destroy();
+        }
+
+        // partitions = 0 derives the number of partitions from the number of keys
+        template<typename Mphf, typename keyType>
+        HostTimer build(const std::vector<keyType> &keys, Mphf &f, uint32_t partitions = 0);
+
+        // releases the buffers and command buffers, the session can be used again afterwards
+        void destroy() {
+            if (keyCapacity != 0) {
+                freeBuffers();
+                keyCapacity = 0;
+                partitionCapacity = 0;
+            }
+            if (positionCapacity != 0) {
+                freePositions();
+            }
+            if (cb != nullptr) {
+                cb->destroy(app.device, app.computeCommandPool);
+                delete cb;
+                cb = nullptr;
+                tailCb->destroy(app.device, app.computeCommandPool);
+                delete tailCb;
+                tailCb = nullptr;
+            }
+            if (positionsCb != nullptr) {
+                positionsCb->destroy(app.device, app.computeCommandPool);
+                delete positionsCb;
+                positionsCb = nullptr;
+            }
+            recorded = false;
+            ppsData.destroy(app.memoryAlloc);
+            if (rawCapacity != 0) {
+                freeRaw();
+            }
+            for (CommandBuffer *&hcb: hashCb) {
+                if (hcb != nullptr) {
+                    hcb->destroy(app.device, app.computeCommandPool);
+                    delete hcb;
+                    hcb = nullptr;
                 }
+            }
+        }
+    };
+
+    template<typename Mphf, typename keyType>
+    class BuildInvocation {
+        Mphf &f;
+        const std::vector<keyType> &keysRaw;
+        uint32_t size;
+        uint32_t partitions;
+        MPHFconfig config;
+        App &app;
+        MPHFbuilder *builder;
+        BuildSession &session;
+
+        uint32_t totalBucketCount;
+
+        // keys per staging slot of the upload without a transfer chunk size
+        static constexpr size_t UPLOAD_CHUNK_KEYS = (8 << 20) / sizeof(Key);
+
+        // bounds of a batch of raw keys that is hashed on the device
+        static constexpr size_t HASH_BATCH_BYTES = 32 << 20;
+        static constexpr uint32_t HASH_BATCH_KEYS = 1 << 20;
+
+        bool pipelined() const {
+            return builder->transferChunkSize != 0;
+        }
+
+        bool deviceHashing() const {
+            return Mphf::template deviceHash<keyType>() && builder->deviceHashing &&
+                   builder->initialHashStage.available();
+        }
+
+    public:
+        BuildInvocation(Mphf &f, const std::vector<keyType> &keysRaw, uint32_t size, uint32_t partitions,
+                        BuildSession &session) : f(f), keysRaw(keysRaw), size(size), partitions(partitions),
+                                                 config(session.config), app(session.app),
+                                                 builder(&session.builder), session(session) {
+            if (partitions == 0) {
+                // an empty key set keeps one empty partition, the encoders do not take empty sequences
+                this->partitions = std::max<uint32_t>(1, (size + config.partitionSize - 1) / config.partitionSize);
+            }
+            totalBucketCount = this->partitions * config.bucketCountPerPartition;
+        }
+
+        void hashInto(Key *dst, size_t begin, size_t end) {
+            if constexpr (Mphf::noHash() && std::is_same_v<Key, keyType>) {
+                std::copy(keysRaw.begin() + begin, keysRaw.begin() + end, dst);
             } else {
-                keys.resize(keysRaw.size());
 #pragma omp parallel for
-                for (int i = 0; i < keysRaw.size(); ++i) {
-                    keys[i] = Mphf::initialHash(keysRaw[i]);
+                for (size_t i = begin; i < end; i += HASH_BATCH_SIZE) {
+                    size_t batchEnd = std::min(i + HASH_BATCH_SIZE, end);
+                    Mphf::initialHashBatch(keysRaw.data() + i, batchEnd - i, dst + (i - begin));
                 }
-                return const_cast<const std::vector<Key> &>(keys);
             }
         }
 
+        // Hashes the keys directly into the mapped slots of the staging ring in turns, without materializing all
+        // keys on the host. While the host hashes a chunk into one slot, the previous chunks are copied from the
+        // other slots on the transfer queue.
+        void hashedUpload(HostTimer &totalTimer) {
+            size_t chunkSize = builder->transferChunkSize != 0 ? builder->transferChunkSize : UPLOAD_CHUNK_KEYS;
+            chunkSize = std::min<size_t>(chunkSize, size);
+
+            double hashTime = 0;
+            double waitTime = 0;
+            for (size_t begin = 0; begin < size; begin += chunkSize) {
+                size_t end = std::min<size_t>(begin + chunkSize, size);
+                double waitStart = totalTimer.elapsed();
+                StagingSlot &slot = app.memoryAlloc.acquireStaging(sizeof(Key) * chunkSize);
+                double hashStart = totalTimer.elapsed();
+                hashInto(static_cast<Key *>(slot.buffer.mapped), begin, end);
+                double hashEnd = totalTimer.elapsed();
+                waitTime += hashStart - waitStart;
+                hashTime += hashEnd - hashStart;
+                totalTimer.addSpan("staging_wait", waitStart, hashStart);
+                totalTimer.addSpan("hash_chunk", hashStart, hashEnd);
+
+                app.memoryAlloc.submitStagingUpload(slot, session.keysSrc, sizeof(Key) * (end - begin),
+                                                    sizeof(Key) * begin);
+            }
+            double waitStart = totalTimer.elapsed();
+            app.memoryAlloc.waitAllStaging();
+            waitTime += totalTimer.elapsed() - waitStart;
+            totalTimer.addLabel("hashed_upload");
+            totalTimer.addMeasurement("upload_hashing", hashTime);
+            totalTimer.addMeasurement("upload_transfer_wait", waitTime);
+        }
+
+        // Packs batches of raw keys into the staging ring and hashes them on the device into keysSrc. Strings are
+        // packed into a character arena followed by the offsets of the batch. While the device hashes one batch,
+        // the host packs and uploads the next one.
+        void deviceInitialHash(HostTimer &totalTimer) {
+            constexpr bool stringKeys = std::is_same_v<keyType, std::string>;
+            double packTime = 0;
+            std::vector<uint32_t> offsets;
+            uint32_t batch = 0;
+            for (size_t begin = 0; begin < size; batch++) {
+                size_t end = begin;
+                size_t bytes = 0;
+                if constexpr (stringKeys) {
+                    offsets.assign(1, 0);
+                    while (end < size && end - begin < HASH_BATCH_KEYS &&
+                           (end == begin || bytes + keysRaw[end].size() <= HASH_BATCH_BYTES)) {
+                        bytes += keysRaw[end].size();
+                        offsets.push_back(bytes);
+                        end++;
+                    }
+                } else {
+                    end = std::min<size_t>(begin + HASH_BATCH_KEYS, size);
+                    bytes = sizeof(uint64_t) * (end - begin);
+                }
+                // the device reads whole words, possibly one beyond the last character
+                size_t paddedBytes = (bytes + 2 * sizeof(uint32_t)) & ~size_t(3);
+
+                uint32_t buffer = batch % 2;
+                session.waitHashing(buffer);
+                session.reserveRaw(std::max<size_t>(paddedBytes, HASH_BATCH_BYTES + 2 * sizeof(uint32_t)),
+                                   HASH_BATCH_KEYS);
+                double packStart = totalTimer.elapsed();
+                StagingSlot &raw = app.memoryAlloc.acquireStaging(paddedBytes);
+                char *dst = static_cast<char *>(raw.buffer.mapped);
+                if constexpr (stringKeys) {
+#pragma omp parallel for
+                    for (size_t i = begin; i < end; i++) {
+                        std::memcpy(dst + offsets[i - begin], keysRaw[i].data(), keysRaw[i].size());
+                    }
+                } else {
+                    std::memcpy(dst, keysRaw.data() + begin, bytes);
+                }
+                std::memset(dst + bytes, 0, paddedBytes - bytes);
+                packTime += totalTimer.elapsed() - packStart;
+                totalTimer.addSpan("pack_batch", packStart, totalTimer.elapsed());
+                app.memoryAlloc.submitStagingUpload(raw, session.rawKeys[buffer], paddedBytes);
+                if constexpr (stringKeys) {
+                    StagingSlot &offsetSlot = app.memoryAlloc.acquireStaging(sizeof(uint32_t) * offsets.size());
+                    std::memcpy(offsetSlot.buffer.mapped, offsets.data(), sizeof(uint32_t) * offsets.size());
+                    app.memoryAlloc.submitStagingUpload(offsetSlot, session.rawOffsets[buffer],
+                                                        sizeof(uint32_t) * offsets.size());
+                }
+                app.memoryAlloc.waitAllStaging();
+                session.submitHashing(buffer, begin, end - begin, stringKeys);
+                begin = end;
+            }
+            session.waitHashing(0);
+            session.waitHashing(1);
+            totalTimer.addLabel("device_hash");
+            totalTimer.addMeasurement("raw_key_packing", packTime);
+        }
+
         std::filesystem::path getCsvPath(std::string name) {
             std::filesystem::path out = std::filesystem::current_path() / ".." / "results";
             std::filesystem::create_directory(out);
@@ -222,55 +708,134 @@ namespace phobicgpu {
             return out;
         }
 
-        HostTimer run() {
+        // Encodes the partition offsets as soon as the first submission completed, while redistribution and
+        // search are still running.
+        void encodePartitionOffsetsEarly(HostTimer &totalTimer, std::vector<uint32_t> &partitionOffsetArray) {
+            session.cb->wait(app.device);
+            double encodeStart = totalTimer.elapsed();
+            partitionOffsetArray.resize(partitions + 1);
+            partitionOffsetArray[0] = 0;
+            fillHostBuffer<uint32_t>(session.partitionsOffsetsHost, partitionOffsetArray.data() + 1, partitions);
+            f.setPartitionOffsets(partitionOffsetArray, partitions, config);
+            double encodeEnd = totalTimer.elapsed();
+            session.tailCb->wait(app.device);
+            double waitEnd = totalTimer.elapsed();
+            totalTimer.addMeasurement("overlapped_offset_encoding", encodeEnd - encodeStart);
+            totalTimer.addMeasurement("search_wait", waitEnd - encodeEnd);
+            totalTimer.addSpan("overlapped_offset_encoding", encodeStart, encodeEnd);
+            totalTimer.addSpan("search_wait", encodeEnd, waitEnd);
+        }
+
+        // the intervals between consecutive timestamps of the build commands on the compute queue
+        void traceStages(const std::vector<TimestampResult> &timestamps) {
+            TimestampCalibration calibration = app.calibrateTimestamps();
+            for (size_t i = 1; i < timestamps.size(); i++) {
+                builder->trace->add(Trace::eCompute, timestamps[i].handle.info.name,
+                                    calibration.toHost(timestamps[i - 1].ticks),
+                                    calibration.toHost(timestamps[i].ticks));
+            }
+        }
+
+        // Vulkan forbids fills and copies of size 0, so an empty key set is encoded without any device commands
+        HostTimer buildEmpty() {
             HostTimer totalTimer;
+            std::vector<uint32_t> partitionOffsetArray(partitions + 1, 0);
+            f.setData(std::vector<uint32_t>(totalBucketCount, 0), partitionOffsetArray, partitions, config);
+            if (builder->positions != nullptr) {
+                builder->positions->clear();
+            }
+            totalTimer.addLabel("encoding");
+            return totalTimer;
+        }
 
-            const std::vector<Key> &keyUpload = initialHash();
-            totalTimer.addLabel("initial_hash");
-            allocateBuffers();
-            totalTimer.addLabel("allocation");
+        HostTimer run() {
+            if (size == 0) {
+                return buildEmpty();
+            }
+            HostTimer totalTimer;
+            if (builder->trace != nullptr) {
+                totalTimer.attachTrace(builder->trace);
+                if (app.transferTimestamps) {
+                    app.memoryAlloc.traceTransfers(builder->trace, app.calibrateTimestamps());
+                }
+            }
 
-            fillDeviceWithStagingBufferVec(app.pDevice, app.device, app.transferCommandPool, app.transferQueue, keysSrc,
-                                           keyUpload);
-            fillDeviceWithStagingBufferVec(app.pDevice, app.device, app.transferCommandPool, app.transferQueue,
-                                           fulcrums,
-                                           config.getFulcs());
-            totalTimer.addLabel("input_transfer");
+            if (deviceHashing()) {
+                session.reserve(size, partitions);
+                totalTimer.addLabel("allocation");
+                deviceInitialHash(totalTimer);
+            } else {
+                session.reserve(size, partitions);
+                totalTimer.addLabel("allocation");
+                hashedUpload(totalTimer);
+            }
 
-            cb = app.createCommandBuffer();
-            addGpuCommands();
+            if (builder->positions != nullptr) {
+                session.reservePositions();
+            }
+            session.prepareCommands(size, partitions, pipelined(), builder->positions != nullptr);
+            CommandBuffer *cb = session.cb;
+            CommandBuffer *tailCb = session.tailCb;
             double gpu2cpuOffset = totalTimer.elapsed();
             totalTimer.addLabel("setup_commands");
-            cb->submit(app.device, app.computeQueue, true);
+            std::vector<uint32_t> partitionOffsetArray;
+            cb->submit(app.device, app.computeQueue, false);
+            tailCb->submit(app.device, app.computeQueue, false);
+            if (pipelined()) {
+                encodePartitionOffsetsEarly(totalTimer, partitionOffsetArray);
+            } else {
+                cb->wait(app.device);
+                tailCb->wait(app.device);
+            }
             cb->readTimestamps(app.device, app.pDevice);
+            tailCb->readTimestamps(app.device, app.pDevice);
             std::vector<TimestampResult> resTS = cb->getTimestamps();
+            // the timestamps of both submissions are taken on the compute queue, the times count from the first
+            float timestampPeriod = app.pDevice.getProperties().limits.timestampPeriod;
+            for (TimestampResult timestamp: tailCb->getTimestamps()) {
+                timestamp.time = timestampPeriod * (timestamp.ticks - resTS[0].ticks);
+                resTS.push_back(timestamp);
+            }
 
             for (int i = 1; i < resTS.size(); i++) {
                 totalTimer.addLabelManually("GPU_" + resTS[i].handle.info.name,
                                           resTS[i].time - resTS[0].time + gpu2cpuOffset);
             }
+            if (builder->trace != nullptr) {
+                traceStages(resTS);
+            }
 
 
-            std::vector<uint32_t> partitionOffsetArray(partitions + 1);
-            partitionOffsetArray[0] = 0;
-            fillHostBuffer<uint32_t>(app.device, partitionsOffsetsHost.memory, partitionOffsetArray.data() + 1,
-                                     partitions);
+            if (!pipelined()) {
+                partitionOffsetArray.resize(partitions + 1);
+                partitionOffsetArray[0] = 0;
+                fillHostBuffer<uint32_t>(session.partitionsOffsetsHost, partitionOffsetArray.data() + 1, partitions);
+            }
 
             std::vector<uint32_t> outputArray(totalBucketCount);
-            fillHostBuffer<uint32_t>(app.device, pilotsHost.memory, outputArray);
+            fillHostBuffer<uint32_t>(session.pilotsHost, outputArray);
+            std::vector<uint32_t> occupancy;
+            if (config.remapped()) {
+                occupancy.resize(size_t(SearchStage::occupancyWords(config)) * partitions);
+                fillHostBuffer<uint32_t>(session.occupancyHost, occupancy);
+            }
             totalTimer.addLabel("result_transfer");
+            if (builder->positions != nullptr && config.slotsPerMille == 1000) {
+                downloadPositions(totalTimer);
+            }
+            if (builder->trace != nullptr) {
+                app.memoryAlloc.traceTransfers(nullptr, {});
+            }
 
             //std::cout << "TIMINGS" << std::endl;
             //totalTimer.printLabels(size);
-            cb->destroy(app.device, app.computeCommandPool);
 
             // debug information
-            /*BufferAllocation print = debugBuffer;
+            /*BufferAllocation print = session.debugBuffer;
             size_t outSize = print.capacity / 4;
             std::vector<uint32_t> debug;
             debug.resize(outSize);
-            fillHostWithStagingBuffer(app.pDevice, app.device, app.transferCommandPool, app.transferQueue, print,
-                                      debug);
+            app.memoryAlloc.download(print, debug.data(), sizeof(uint32_t) * debug.size());
 
             for(auto v : debug) {
                 std::cout<<v<<" ";
@@ -286,37 +851,63 @@ namespace phobicgpu {
             }
             csv.close();*/
 
-            f.setData(outputArray, partitionOffsetArray, partitions, config);
+            if (pipelined()) {
+                f.setPilots(outputArray);
+            } else {
+                f.setData(outputArray, partitionOffsetArray, partitions, config);
+            }
+            if (config.remapped()) {
+                f.setOccupancy(occupancy, SearchStage::occupancyWords(config));
+            }
             totalTimer.addLabel("encoding");
+
+            if (builder->positions != nullptr && config.slotsPerMille != 1000) {
+                std::vector<uint32_t> bounds(partitions + 1, 0);
+                for (uint32_t partition = 0; partition < partitions; partition++) {
+                    bounds[partition + 1] = bounds[partition] + config.partitionSlots(
+                            partitionOffsetArray[partition + 1] - partitionOffsetArray[partition]);
+                }
+                session.submitPositions(bounds);
+                totalTimer.addLabel("positions");
+                downloadPositions(totalTimer);
+                if (config.remapped()) {
+                    std::vector<uint32_t> &positions = *builder->positions;
+#pragma omp parallel for
+                    for (size_t i = 0; i < positions.size(); i++) {
+                        positions[i] = uint32_t(f.remapPosition(positions[i]));
+                    }
+                    totalTimer.addLabel("positions_remap");
+                }
+            }
             return totalTimer;
         }
 
-
-        void destroy() {
-            partitionsSizes.free(app.memoryAlloc);
-            partitionsOffsetsDevice.free(app.memoryAlloc);
-            partitionsOffsetsHost.free(app.memoryAlloc);
-            bucketSizeHistogram.free(app.memoryAlloc);
-            debugBuffer.free(app.memoryAlloc);
-            keysSrc.free(app.memoryAlloc);
-            keysLowerDst.free(app.memoryAlloc);
-            keyOffsets.free(app.memoryAlloc);
-            bucketSizes.free(app.memoryAlloc);
-            bucketPermuatation.free(app.memoryAlloc);
-            pilotsDevice.free(app.memoryAlloc);
-            pilotsHost.free(app.memoryAlloc);
-            fulcrums.free(app.memoryAlloc);
-
-            ppsData.destroy(app.memoryAlloc);
+        void downloadPositions(HostTimer &totalTimer) {
+            builder->positions->resize(size);
+            if (size != 0) {
+                app.memoryAlloc.download(session.positionsDevice, builder->positions->data(),
+                                         sizeof(uint32_t) * size);
+            }
+            totalTimer.addLabel("positions_transfer");
         }
     };
 
 
     template<typename Mphf, typename keyType>
-    HostTimer MPHFbuilder::build(const std::vector<keyType> &keys, Mphf &f) {
-        BuildInvocation<Mphf, keyType> bd(f, keys, keys.size(), config, app, this);
-        HostTimer timings = bd.run();
-        bd.destroy();
+    HostTimer BuildSession::build(const std::vector<keyType> &keys, Mphf &f, uint32_t partitions) {
+        // device indices are 32-bit, larger key sets are split into super-batches by StreamingMPHFbuilder
+        if (keys.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("more than 2^32 keys require StreamingMPHFbuilder");
+        }
+        BuildInvocation<Mphf, keyType> bd(f, keys, keys.size(), partitions, *this);
+        return bd.run();
+    }
+
+    template<typename Mphf, typename keyType>
+    HostTimer MPHFbuilder::build(const std::vector<keyType> &keys, Mphf &f, uint32_t partitions) {
+        BuildSession session(*this);
+        HostTimer timings = session.build(keys, f, partitions);
+        session.destroy();
         return timings;
     }
-}
\ No newline at end of file
+}
@@ -3,6 +3,7 @@
 #include <cmath>
 #include "shader_constants.h"
 #include <numeric>
+#include <stdexcept>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -22,6 +23,10 @@ namespace phobicgpu {
         uint32_t bucketCountPerPartition;
         uint32_t sortingBins;
         double m_averageBucketSize;
+        // positions per 1000 keys of a partition and whether the positions beyond the number of keys are remapped,
+        // see setLoadFactor
+        uint32_t slotsPerMille = 1000;
+        bool minimal = true;
 
         MPHFconfig(double averageBucketSize = 8.0, uint32_t partitionSize = 2048) :
                 partitionSize(partitionSize),
@@ -62,6 +67,33 @@ namespace phobicgpu {
             // ToDo use Poission quantil
             return partitionSize + partitionSize / 2;
         }
+
+        // Lets the keys of a partition fill only a fraction alpha of its positions, which makes the search for the
+        // pilots of the last buckets much faster. The function then maps to about keys / alpha positions. If
+        // minimal, the occupied positions from the number of keys on are remapped to the free ones below it with an
+        // Elias-Fano sequence, otherwise the function is perfect but not minimal.
+        void setLoadFactor(double alpha, bool minimal = true) {
+            if (!(alpha >= 0.5 && alpha <= 1.0)) {
+                throw std::runtime_error("the load factor has to be between 0.5 and 1");
+            }
+            slotsPerMille = uint32_t(std::round(1000.0 / alpha));
+            this->minimal = minimal;
+        }
+
+        // positions of a partition with the given number of keys, as computed by the search shader
+        uint32_t partitionSlots(uint32_t keys) const {
+            return uint32_t((uint64_t(keys) * slotsPerMille + 999) / 1000);
+        }
+
+        // positions of the largest partition, a multiple of 32 for the bitmaps of the search
+        uint32_t partitionMaxSlots() const {
+            return (partitionSlots(partitionMaxSize()) + 31) / 32 * 32;
+        }
+
+        // whether builds pass the occupied positions of the search to the function, see MPHF::setOccupancy
+        bool remapped() const {
+            return slotsPerMille != 1000 && minimal;
+        }
     };
 
 }
\ No newline at end of file
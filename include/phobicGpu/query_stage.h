@@ -0,0 +1,32 @@
+#pragma once
+
+#include "app/app.h"
+#include "app/command_buffer.h"
+
+namespace phobicgpu {
+
+    struct PushStructQuery {
+        uint32_t size;
+        uint32_t partitionCount;
+        uint32_t bucketCount;
+        // positions from keyCount on are looked up in the remap buffer
+        uint32_t keyCount;
+    };
+
+    class QueryStage {
+    private:
+        App &app;
+        const ShaderStage *queryStage;
+
+        uint32_t workGroupSize;
+
+    public:
+        QueryStage(App &app, uint32_t workGroupSize);
+
+        // evaluates the function for constants.size keys, the buffers hold a DeviceQueryData
+        void addCommands(CommandBuffer *cb, PushStructQuery constants, vk::Buffer keys, vk::Buffer partitionOffsets,
+                         vk::Buffer pilotColumns, vk::Buffer pilotBits, vk::Buffer remap, vk::Buffer results,
+                         vk::Buffer fulcs);
+    };
+
+}
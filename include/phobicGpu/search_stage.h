@@ -22,10 +22,16 @@ namespace phobicgpu {
     public:
         SearchStage(App &app, uint32_t workGroupSize, MPHFconfig config);
 
+        // the occupied positions of partition p are a bitmap at word p * occupancyWords of occupancy, only
+        // written if config.remapped()
+        static uint32_t occupancyWords(const MPHFconfig &config) {
+            return config.partitionMaxSlots() / 32;
+        }
+
         void addCommands(CommandBuffer *cb, uint32_t partitions,
                          vk::Buffer keys, vk::Buffer bucketSizeHisto, vk::Buffer partitionSizes,
                          vk::Buffer bucketPermuatation, vk::Buffer pilots, vk::Buffer partitionsOffsets,
-                         vk::Buffer debug);
+                         vk::Buffer debug, vk::Buffer occupancy);
 
         void destroy();
     };
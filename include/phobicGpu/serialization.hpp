@@ -0,0 +1,291 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "encoders/base/mappable_vector.hpp"
+
+namespace phobicgpu {
+
+    // "PHOBICGP" in little endian
+    static const uint64_t MPHF_FILE_MAGIC = 0x50474349424f4850;
+    static const uint32_t MPHF_FILE_VERSION = 2;
+
+    // Writes an object using its visit() method. Arrays are stored as their size followed by the raw elements
+    // which start at a multiple of 8 bytes (or of their alignment if larger), such that they can be used in
+    // place from a memory mapped file.
+    class saver {
+    private:
+        std::ofstream out;
+        size_t written = 0;
+
+        void write(const void *data, size_t bytes) {
+            out.write(reinterpret_cast<const char *>(data), bytes);
+            written += bytes;
+        }
+
+        void align(size_t alignment = 8) {
+            static const char zeros[64] = {};
+            write(zeros, (alignment - written % alignment) % alignment);
+        }
+
+        template<typename T>
+        void visitArray(const T *data, uint64_t size) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            visit(size);
+            align(std::max<size_t>(8, alignof(T)));
+            write(data, sizeof(T) * size);
+        }
+
+    public:
+        saver(const std::string &filename) : out(filename, std::ios::binary) {
+            if (!out.good()) {
+                throw std::runtime_error("failed to open file: " + filename);
+            }
+        }
+
+        template<typename T>
+        void visit(T &val) {
+            if constexpr (std::is_arithmetic_v<T>) {
+                write(&val, sizeof(T));
+            } else {
+                val.visit(*this);
+            }
+        }
+
+        template<typename T>
+        void visit(mappable_vector<T> &vec) {
+            visitArray(vec.data(), vec.size());
+        }
+
+        template<typename T>
+        void visit(std::vector<T> &vec) {
+            visitArray(vec.data(), vec.size());
+        }
+
+        void visit(std::string &str) {
+            visitArray(str.data(), str.size());
+        }
+
+        // see loader::checkItems
+        void checkItems(uint64_t count, size_t minBytes) {}
+
+        // pads the file such that word reads beyond the last array stay inside the mapping
+        size_t finish() {
+            align();
+            static const char zeros[8] = {};
+            write(zeros, sizeof(zeros));
+            out.flush();
+            if (!out.good()) {
+                throw std::runtime_error("failed to write file");
+            }
+            return written;
+        }
+    };
+
+    // Reads an object written by saver from memory. With zeroCopy the arrays point into the memory, which then
+    // has to outlive the object, otherwise they are copied.
+    class loader {
+    private:
+        const char *begin;
+        const char *cur;
+        const char *end;
+        bool zeroCopy;
+
+        void read(void *dst, size_t bytes) {
+            if (size_t(end - cur) < bytes) {
+                throw std::runtime_error("unexpected end of file");
+            }
+            std::memcpy(dst, cur, bytes);
+            cur += bytes;
+        }
+
+        void align(size_t alignment = 8) {
+            cur += (alignment - (cur - begin) % alignment) % alignment;
+        }
+
+        template<typename T>
+        const T *readArray(uint64_t &size) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            visit(size);
+            align(std::max<size_t>(8, alignof(T)));
+            if (cur > end || size > size_t(end - cur) / sizeof(T)) {
+                throw std::runtime_error("unexpected end of file");
+            }
+            const T *data = reinterpret_cast<const T *>(cur);
+            cur += sizeof(T) * size;
+            return data;
+        }
+
+    public:
+        loader(const char *data, size_t size, bool zeroCopy) : begin(data), cur(data), end(data + size),
+                                                               zeroCopy(zeroCopy) {}
+
+        template<typename T>
+        void visit(T &val) {
+            if constexpr (std::is_arithmetic_v<T>) {
+                read(&val, sizeof(T));
+            } else {
+                val.visit(*this);
+            }
+        }
+
+        template<typename T>
+        void visit(mappable_vector<T> &vec) {
+            uint64_t size;
+            const T *data = readArray<T>(size);
+            if (zeroCopy) {
+                vec.map(data, size);
+            } else {
+                vec = huge_page_vector<T>(data, data + size);
+            }
+        }
+
+        template<typename T>
+        void visit(std::vector<T> &vec) {
+            uint64_t size;
+            const T *data = readArray<T>(size);
+            vec.assign(data, data + size);
+        }
+
+        void visit(std::string &str) {
+            uint64_t size;
+            const char *data = readArray<char>(size);
+            str.assign(data, size);
+        }
+
+        // Called before allocating count objects whose sizes were read from the memory, each of which takes at
+        // least minBytes of it, such that a corrupted count throws instead of allocating arbitrary amounts.
+        void checkItems(uint64_t count, size_t minBytes) {
+            if (cur > end || count > size_t(end - cur) / minBytes) {
+                throw std::runtime_error("unexpected end of file");
+            }
+        }
+    };
+
+    // The type of a tag without the loaded parameters, i.e., every field between '<', ',' and '>' that is a
+    // number, such as the tradeoff of interleaved_encoder_dual or the bits of FingerprintMphf.
+    inline std::string tagType(const std::string &tag) {
+        std::string type;
+        size_t field = 0;
+        for (size_t i = 0; i <= tag.size(); i++) {
+            if (i == tag.size() || tag[i] == '<' || tag[i] == ',' || tag[i] == '>') {
+                std::string value = tag.substr(field, i - field);
+                bool number = !value.empty() && value.find_first_not_of("0123456789.") == std::string::npos;
+                type += number ? "#" : value;
+                if (i < tag.size()) {
+                    type += tag[i];
+                }
+                field = i + 1;
+            }
+        }
+        return type;
+    }
+
+    // Read-only memory mapping of a whole file, unmapped on destruction.
+    class MemoryMappedFile {
+    private:
+        void *mapping;
+        size_t fileSize;
+
+    public:
+        MemoryMappedFile(const std::string &filename) {
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd == -1) {
+                throw std::runtime_error("failed to open file: " + filename);
+            }
+            struct stat st;
+            if (fstat(fd, &st) == -1) {
+                close(fd);
+                throw std::runtime_error("failed to stat file: " + filename);
+            }
+            fileSize = st.st_size;
+            mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapping == MAP_FAILED) {
+                throw std::runtime_error("failed to map file: " + filename);
+            }
+        }
+
+        MemoryMappedFile(const MemoryMappedFile &) = delete;
+
+        MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+        ~MemoryMappedFile() {
+            munmap(mapping, fileSize);
+        }
+
+        const char *data() const {
+            return reinterpret_cast<const char *>(mapping);
+        }
+
+        size_t size() const {
+            return fileSize;
+        }
+    };
+
+    // Stores the function with a versioned header that contains its type tag. Returns the file size.
+    template<typename Mphf>
+    size_t save(Mphf &f, const std::string &filename) {
+        saver s(filename);
+        uint64_t magic = MPHF_FILE_MAGIC;
+        uint32_t version = MPHF_FILE_VERSION;
+        std::string tag = f.name();
+        s.visit(magic);
+        s.visit(version);
+        s.visit(tag);
+        s.visit(f);
+        return s.finish();
+    }
+
+    template<typename Mphf>
+    void load(Mphf &f, const char *data, size_t size, bool zeroCopy) {
+        loader l(data, size, zeroCopy);
+        uint64_t magic;
+        uint32_t version;
+        std::string tag;
+        l.visit(magic);
+        if (magic != MPHF_FILE_MAGIC) {
+            throw std::runtime_error("not a serialized MPHF");
+        }
+        l.visit(version);
+        if (version != MPHF_FILE_VERSION) {
+            throw std::runtime_error("unsupported MPHF file version " + std::to_string(version));
+        }
+        l.visit(tag);
+        // the type is checked before reading any sizes of f, the full tag after loading because it includes
+        // loaded parameters like the dual encoder tradeoff
+        if (tagType(tag) != tagType(f.name())) {
+            throw std::runtime_error("stored function " + tag + " does not match " + f.name());
+        }
+        l.visit(f);
+        if (tag != f.name()) {
+            throw std::runtime_error("stored function " + tag + " does not match " + f.name());
+        }
+    }
+
+    // Loads a copy of the function, the file is not needed afterwards.
+    template<typename Mphf>
+    void load(Mphf &f, const std::string &filename) {
+        MemoryMappedFile file(filename);
+        load(f, file.data(), file.size(), false);
+    }
+
+    // Serves queries directly from the mapped file without copying the encoded data,
+    // the file has to outlive f.
+    template<typename Mphf>
+    void map(Mphf &f, const MemoryMappedFile &file) {
+        load(f, file.data(), file.size(), true);
+    }
+
+}
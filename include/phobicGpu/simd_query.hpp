@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "shader_constants.h"
+
+namespace phobicgpu {
+
+    // Flat view of the data read by queries of MPHF<interleaved_encoder<compact>, diff_partition_encoder<compact>, H>
+    // and of the same MPHF with flat_interleaved_encoder<compact>.
+    // Pilots of bucket b are stored with pilotWidths[b] bits per partition starting at the address pilotBits[b].
+    struct SimdQueryTables {
+        const uint32_t *fulcs;
+        uint32_t partitions;
+        const uint64_t *pilotBits;
+        const uint32_t *pilotWidths;
+        const char *offsetBits;
+        uint32_t offsetWidth;
+        uint32_t offsetIncrement;
+    };
+
+    // Query kernels that evaluate one key per 32-bit lane. They produce exactly the results of MPHF::operator(),
+    // the fastmod reductions are replaced by double precision divisions, which are exact for 32-bit operands.
+    namespace simd {
+
+#if defined(__AVX512F__)
+        static constexpr size_t LANES = 16;
+
+        inline __m512i mulhi(__m512i a, __m512i b) {
+            __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(a, b), 32);
+            __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32));
+            return _mm512_mask_blend_epi32(0xAAAA, even, odd);
+        }
+
+        inline __m512i hash(__m512i pilot, __m512i key) {
+            const __m512i mul = _mm512_set1_epi32(0x45d9f3b);
+            key = _mm512_xor_si512(key, pilot);
+            key = _mm512_mullo_epi32(_mm512_xor_si512(_mm512_srli_epi32(key, 16), key), mul);
+            key = _mm512_mullo_epi32(_mm512_xor_si512(_mm512_srli_epi32(key, 16), key), mul);
+            return _mm512_xor_si512(_mm512_srli_epi32(key, 16), key);
+        }
+
+        inline __m256i div(__m256i x, __m256i d) {
+            return _mm512_cvttpd_epu32(_mm512_div_pd(_mm512_cvtepu32_pd(x), _mm512_cvtepu32_pd(d)));
+        }
+
+        // x / d, the remainder follows as x - q * d
+        inline __m512i div(__m512i x, __m512i d) {
+            __m256i lo = div(_mm512_castsi512_si256(x), _mm512_castsi512_si256(d));
+            __m256i hi = div(_mm512_extracti64x4_epi64(x, 1), _mm512_extracti64x4_epi64(d, 1));
+            return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+        }
+
+        // reads width bits at bitPos from the words starting at the 64-bit addresses base
+        inline __m512i readBits(__m512i base, __m256i bitPos, __m256i width) {
+            __m512i pos = _mm512_cvtepu32_epi64(bitPos);
+            __m512i addr = _mm512_add_epi64(base, _mm512_srli_epi64(pos, 3));
+            __m512i word = _mm512_i64gather_epi64(addr, nullptr, 1);
+            __m512i mask = _mm512_sub_epi64(_mm512_sllv_epi64(_mm512_set1_epi64(1), _mm512_cvtepu32_epi64(width)),
+                                            _mm512_set1_epi64(1));
+            return _mm512_and_si512(_mm512_srlv_epi64(word, _mm512_and_si512(pos, _mm512_set1_epi64(7))), mask);
+        }
+
+        // decodes the zig-zag style values of linear_diff_encoder
+        inline __m256i decodeDiff(__m512i value) {
+            __m256i magnitude = _mm512_cvtepi64_epi32(_mm512_srli_epi64(value, 1));
+            // all ones for negative values
+            __m256i negative = _mm256_sub_epi32(_mm256_and_si256(_mm512_cvtepi64_epi32(value), _mm256_set1_epi32(1)),
+                                                _mm256_set1_epi32(1));
+            return _mm256_sub_epi32(_mm256_xor_si256(magnitude, negative), negative);
+        }
+
+        inline __m512i combine(__m256i lo, __m256i hi) {
+            return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+        }
+
+        inline void partitionsAndBuckets(const SimdQueryTables &t, const uint32_t *partitioner,
+                                         const uint32_t *bucketer, uint32_t *partitionOut, uint32_t *bucketOut) {
+            __m512i partition = mulhi(_mm512_loadu_si512(partitioner), _mm512_set1_epi32(t.partitions));
+            _mm512_storeu_si512(partitionOut, partition);
+
+            const __m512i inter = _mm512_set1_epi32(FULCS_INTER - 1);
+            __m512i bits = _mm512_loadu_si512(bucketer);
+            __m512i index = mulhi(bits, inter);
+            __m512i part = _mm512_mullo_epi32(bits, inter);
+            __m512i v1 = mulhi(_mm512_i32gather_epi32(index, t.fulcs, 4), part);
+            __m512i v2 = mulhi(_mm512_i32gather_epi32(index, t.fulcs + 1, 4), _mm512_xor_si512(part, _mm512_set1_epi32(-1)));
+            const __m512i low = _mm512_set1_epi32(0xFFFF);
+            __m512i carry = _mm512_srli_epi32(_mm512_add_epi32(_mm512_and_si512(v1, low), _mm512_and_si512(v2, low)), 16);
+            __m512i bucket = _mm512_add_epi32(_mm512_add_epi32(_mm512_srli_epi32(v1, 16), _mm512_srli_epi32(v2, 16)), carry);
+            _mm512_storeu_si512(bucketOut, bucket);
+        }
+
+        inline void resolve(const SimdQueryTables &t, const uint32_t *partitionIn, const uint32_t *bucketIn,
+                            const uint32_t *lower1In, const uint32_t *lower2In, uint32_t *out) {
+            __m512i partition = _mm512_loadu_si512(partitionIn);
+            __m512i bucket = _mm512_loadu_si512(bucketIn);
+
+            __m512i width = _mm512_i32gather_epi32(bucket, t.pilotWidths, 4);
+            __m512i bitPos = _mm512_mullo_epi32(partition, width);
+            __m512i pilot = combine(
+                    _mm512_cvtepi64_epi32(readBits(_mm512_i32gather_epi64(_mm512_castsi512_si256(bucket), t.pilotBits, 8),
+                                                   _mm512_castsi512_si256(bitPos), _mm512_castsi512_si256(width))),
+                    _mm512_cvtepi64_epi32(readBits(_mm512_i32gather_epi64(_mm512_extracti64x4_epi64(bucket, 1), t.pilotBits, 8),
+                                                   _mm512_extracti64x4_epi64(bitPos, 1), _mm512_extracti64x4_epi64(width, 1))));
+
+            const __m512i offsetBase = _mm512_set1_epi64(int64_t(t.offsetBits));
+            const __m256i offsetWidth = _mm256_set1_epi32(t.offsetWidth);
+            __m512i bitPos0 = _mm512_mullo_epi32(partition, _mm512_set1_epi32(t.offsetWidth));
+            __m512i bitPos1 = _mm512_add_epi32(bitPos0, _mm512_set1_epi32(t.offsetWidth));
+            __m512i expected = _mm512_mullo_epi32(partition, _mm512_set1_epi32(t.offsetIncrement));
+            __m512i offset0 = combine(decodeDiff(readBits(offsetBase, _mm512_castsi512_si256(bitPos0), offsetWidth)),
+                                      decodeDiff(readBits(offsetBase, _mm512_extracti64x4_epi64(bitPos0, 1), offsetWidth)));
+            __m512i offset1 = combine(decodeDiff(readBits(offsetBase, _mm512_castsi512_si256(bitPos1), offsetWidth)),
+                                      decodeDiff(readBits(offsetBase, _mm512_extracti64x4_epi64(bitPos1, 1), offsetWidth)));
+            offset0 = _mm512_add_epi32(offset0, expected);
+            offset1 = _mm512_add_epi32(offset1, _mm512_add_epi32(expected, _mm512_set1_epi32(t.offsetIncrement)));
+            __m512i partitionSize = _mm512_sub_epi32(offset1, offset0);
+
+            __m512i hashPilot = div(pilot, partitionSize);
+            __m512i hashValue = _mm512_srli_epi32(
+                    hash(_mm512_loadu_si512(lower1In), hash(_mm512_loadu_si512(lower2In), hashPilot)), 1);
+            __m512i x = _mm512_add_epi32(hashValue, pilot);
+            __m512i pos = _mm512_sub_epi32(x, _mm512_mullo_epi32(div(x, partitionSize), partitionSize));
+            _mm512_storeu_si512(out, _mm512_add_epi32(offset0, pos));
+        }
+
+#elif defined(__AVX2__)
+        static constexpr size_t LANES = 8;
+
+        inline __m256i mulhi(__m256i a, __m256i b) {
+            __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(a, b), 32);
+            __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+            return _mm256_blend_epi32(even, odd, 0xAA);
+        }
+
+        inline __m256i hash(__m256i pilot, __m256i key) {
+            const __m256i mul = _mm256_set1_epi32(0x45d9f3b);
+            key = _mm256_xor_si256(key, pilot);
+            key = _mm256_mullo_epi32(_mm256_xor_si256(_mm256_srli_epi32(key, 16), key), mul);
+            key = _mm256_mullo_epi32(_mm256_xor_si256(_mm256_srli_epi32(key, 16), key), mul);
+            return _mm256_xor_si256(_mm256_srli_epi32(key, 16), key);
+        }
+
+        inline __m256d toDouble(__m128i x) {
+            const __m128i sign = _mm_set1_epi32(0x80000000);
+            return _mm256_add_pd(_mm256_cvtepi32_pd(_mm_xor_si128(x, sign)), _mm256_set1_pd(2147483648.0));
+        }
+
+        inline __m128i div(__m128i x, __m128i d) {
+            __m256d q = _mm256_floor_pd(_mm256_div_pd(toDouble(x), toDouble(d)));
+            __m128i shifted = _mm256_cvttpd_epi32(_mm256_sub_pd(q, _mm256_set1_pd(2147483648.0)));
+            return _mm_xor_si128(shifted, _mm_set1_epi32(0x80000000));
+        }
+
+        // x / d, the remainder follows as x - q * d
+        inline __m256i div(__m256i x, __m256i d) {
+            __m128i lo = div(_mm256_castsi256_si128(x), _mm256_castsi256_si128(d));
+            __m128i hi = div(_mm256_extracti128_si256(x, 1), _mm256_extracti128_si256(d, 1));
+            return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        }
+
+        // keeps the lower 32 bits of the 64-bit lanes
+        inline __m256i pack(__m256i lo, __m256i hi) {
+            const __m256i order = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+            return _mm256_blend_epi32(_mm256_permutevar8x32_epi32(lo, order),
+                                      _mm256_permutevar8x32_epi32(hi, order), 0xF0);
+        }
+
+        // reads width bits at bitPos from the words starting at the 64-bit addresses base
+        inline __m256i readBits(__m256i base, __m128i bitPos, __m128i width) {
+            __m256i pos = _mm256_cvtepu32_epi64(bitPos);
+            __m256i addr = _mm256_add_epi64(base, _mm256_srli_epi64(pos, 3));
+            __m256i word = _mm256_i64gather_epi64(nullptr, addr, 1);
+            __m256i mask = _mm256_sub_epi64(_mm256_sllv_epi64(_mm256_set1_epi64x(1), _mm256_cvtepu32_epi64(width)),
+                                            _mm256_set1_epi64x(1));
+            return _mm256_and_si256(_mm256_srlv_epi64(word, _mm256_and_si256(pos, _mm256_set1_epi64x(7))), mask);
+        }
+
+        // decodes the zig-zag style values of linear_diff_encoder
+        inline __m256i decodeDiff(__m256i lo, __m256i hi) {
+            __m256i magnitude = pack(_mm256_srli_epi64(lo, 1), _mm256_srli_epi64(hi, 1));
+            // all ones for negative values
+            __m256i negative = _mm256_sub_epi32(_mm256_and_si256(pack(lo, hi), _mm256_set1_epi32(1)),
+                                                _mm256_set1_epi32(1));
+            return _mm256_sub_epi32(_mm256_xor_si256(magnitude, negative), negative);
+        }
+
+        inline void partitionsAndBuckets(const SimdQueryTables &t, const uint32_t *partitioner,
+                                         const uint32_t *bucketer, uint32_t *partitionOut, uint32_t *bucketOut) {
+            __m256i partition = mulhi(_mm256_loadu_si256((const __m256i *) partitioner), _mm256_set1_epi32(t.partitions));
+            _mm256_storeu_si256((__m256i *) partitionOut, partition);
+
+            const __m256i inter = _mm256_set1_epi32(FULCS_INTER - 1);
+            __m256i bits = _mm256_loadu_si256((const __m256i *) bucketer);
+            __m256i index = mulhi(bits, inter);
+            __m256i part = _mm256_mullo_epi32(bits, inter);
+            __m256i v1 = mulhi(_mm256_i32gather_epi32((const int *) t.fulcs, index, 4), part);
+            __m256i v2 = mulhi(_mm256_i32gather_epi32((const int *) t.fulcs + 1, index, 4),
+                               _mm256_xor_si256(part, _mm256_set1_epi32(-1)));
+            const __m256i low = _mm256_set1_epi32(0xFFFF);
+            __m256i carry = _mm256_srli_epi32(_mm256_add_epi32(_mm256_and_si256(v1, low), _mm256_and_si256(v2, low)), 16);
+            __m256i bucket = _mm256_add_epi32(_mm256_add_epi32(_mm256_srli_epi32(v1, 16), _mm256_srli_epi32(v2, 16)), carry);
+            _mm256_storeu_si256((__m256i *) bucketOut, bucket);
+        }
+
+        inline void resolve(const SimdQueryTables &t, const uint32_t *partitionIn, const uint32_t *bucketIn,
+                            const uint32_t *lower1In, const uint32_t *lower2In, uint32_t *out) {
+            __m256i partition = _mm256_loadu_si256((const __m256i *) partitionIn);
+            __m256i bucket = _mm256_loadu_si256((const __m256i *) bucketIn);
+
+            __m256i width = _mm256_i32gather_epi32((const int *) t.pilotWidths, bucket, 4);
+            __m256i bitPos = _mm256_mullo_epi32(partition, width);
+            __m256i pilot = pack(
+                    readBits(_mm256_i32gather_epi64((const long long *) t.pilotBits, _mm256_castsi256_si128(bucket), 8),
+                             _mm256_castsi256_si128(bitPos), _mm256_castsi256_si128(width)),
+                    readBits(_mm256_i32gather_epi64((const long long *) t.pilotBits, _mm256_extracti128_si256(bucket, 1), 8),
+                             _mm256_extracti128_si256(bitPos, 1), _mm256_extracti128_si256(width, 1)));
+
+            const __m256i offsetBase = _mm256_set1_epi64x(int64_t(t.offsetBits));
+            const __m128i offsetWidth = _mm_set1_epi32(t.offsetWidth);
+            __m256i bitPos0 = _mm256_mullo_epi32(partition, _mm256_set1_epi32(t.offsetWidth));
+            __m256i bitPos1 = _mm256_add_epi32(bitPos0, _mm256_set1_epi32(t.offsetWidth));
+            __m256i expected = _mm256_mullo_epi32(partition, _mm256_set1_epi32(t.offsetIncrement));
+            __m256i offset0 = decodeDiff(readBits(offsetBase, _mm256_castsi256_si128(bitPos0), offsetWidth),
+                                         readBits(offsetBase, _mm256_extracti128_si256(bitPos0, 1), offsetWidth));
+            __m256i offset1 = decodeDiff(readBits(offsetBase, _mm256_castsi256_si128(bitPos1), offsetWidth),
+                                         readBits(offsetBase, _mm256_extracti128_si256(bitPos1, 1), offsetWidth));
+            offset0 = _mm256_add_epi32(offset0, expected);
+            offset1 = _mm256_add_epi32(offset1, _mm256_add_epi32(expected, _mm256_set1_epi32(t.offsetIncrement)));
+            __m256i partitionSize = _mm256_sub_epi32(offset1, offset0);
+
+            __m256i hashPilot = div(pilot, partitionSize);
+            __m256i hashValue = _mm256_srli_epi32(
+                    hash(_mm256_loadu_si256((const __m256i *) lower1In),
+                         hash(_mm256_loadu_si256((const __m256i *) lower2In), hashPilot)), 1);
+            __m256i x = _mm256_add_epi32(hashValue, pilot);
+            __m256i pos = _mm256_sub_epi32(x, _mm256_mullo_epi32(div(x, partitionSize), partitionSize));
+            _mm256_storeu_si256((__m256i *) out, _mm256_add_epi32(offset0, pos));
+        }
+#endif
+    }
+}
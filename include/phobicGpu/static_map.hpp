@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "app/host_timer.h"
+#include "encoders/base/compact_vector.hpp"
+#include "encoders/base/huge_page_allocator.hpp"
+#include "encoders/base/mappable_vector.hpp"
+#include "encoders/base/util.hpp"
+
+namespace phobicgpu {
+
+    // Immutable map from the keys of one build to values, the value of a key is stored at its position under the
+    // function. get() evaluates the function and reads one value. Unsigned integers are stored in a compact_vector
+    // with the width of the largest value, other types as a plain array, which requires trivially copyable values
+    // for save(), load() and map().
+    template<typename Mphf, typename Value>
+    class StaticMap {
+    private:
+        static constexpr bool compactValues = std::is_integral_v<Value> && std::is_unsigned_v<Value>;
+        typedef std::conditional_t<compactValues, compact_vector, mappable_vector<Value>> ValueArray;
+
+        Mphf f;
+        ValueArray valuesByPosition;
+
+        inline Value valueAt(uint64_t position) const {
+            if constexpr (compactValues) {
+                return Value(valuesByPosition[position]);
+            } else {
+                return valuesByPosition[position];
+            }
+        }
+
+        inline void prefetchValue(uint64_t position) const {
+            if constexpr (compactValues) {
+                valuesByPosition.prefetch(position);
+            } else {
+                util::prefetch(valuesByPosition.data() + position);
+            }
+        }
+
+    public:
+        // Builds the function with builder (MPHFbuilder or CPUMPHFbuilder) and stores values[i] for keys[i]. The
+        // builder outputs the positions of all keys, see setPositionOutput, and the values are scattered to them
+        // in parallel.
+        template<typename Builder, typename keyType>
+        HostTimer build(Builder &builder, const std::vector<keyType> &keys, const std::vector<Value> &values) {
+            if (keys.size() != values.size()) {
+                throw std::runtime_error("StaticMap requires one value per key");
+            }
+            std::vector<uint32_t> positions;
+            builder.setPositionOutput(&positions);
+            HostTimer timer;
+            try {
+                timer = builder.build(keys, f);
+            } catch (...) {
+                builder.setPositionOutput(nullptr);
+                throw;
+            }
+            builder.setPositionOutput(nullptr);
+
+            size_t n = keys.size();
+            // a function built with a load factor below 1 and without remapping has more positions than keys,
+            // std::vector<bool> packs bits, which are not written independently in parallel
+            huge_page_vector<std::conditional_t<std::is_same_v<Value, bool>, uint8_t, Value>> scattered(f.range());
+#pragma omp parallel for
+            for (size_t i = 0; i < n; i++) {
+                scattered[positions[i]] = values[i];
+            }
+            if constexpr (compactValues) {
+                valuesByPosition = compact_vector();
+                if (n != 0) {
+                    valuesByPosition.build(scattered.begin(), scattered.size());
+                }
+            } else {
+                valuesByPosition = std::move(scattered);
+            }
+            timer.addLabel("scatter_values");
+            return timer;
+        }
+
+        template<typename keyType>
+        inline Value get(const keyType &key) const {
+            return valueAt(f(key));
+        }
+
+        // get() for n keys, the positions are computed with lookup_batch and the values of a window are
+        // prefetched before they are read
+        template<typename keyType>
+        void get_batch(const keyType *keys, size_t n, Value *out) const {
+            uint64_t positions[Mphf::LOOKUP_WINDOW];
+            for (size_t begin = 0; begin < n; begin += Mphf::LOOKUP_WINDOW) {
+                size_t windowSize = std::min(Mphf::LOOKUP_WINDOW, n - begin);
+                f.lookup_batch(keys + begin, windowSize, positions);
+                for (size_t i = 0; i < windowSize; i++) {
+                    prefetchValue(positions[i]);
+                }
+                for (size_t i = 0; i < windowSize; i++) {
+                    out[begin + i] = valueAt(positions[i]);
+                }
+            }
+        }
+
+        // number of keys
+        uint64_t size() const {
+            return f.size();
+        }
+
+        const Mphf &function() const {
+            return f;
+        }
+
+        float getBitsPerKey() const {
+            if constexpr (compactValues) {
+                return f.getBitsPerKey() + float(valuesByPosition.bytes() * 8) / float(size());
+            } else {
+                return f.getBitsPerKey() + float(sizeof(Value) * 8 * valuesByPosition.size()) / float(size());
+            }
+        }
+
+        // type tag stored in serialized maps
+        std::string name() const {
+            return "StaticMap<" + f.name() + "," +
+                   (compactValues ? std::string("compact") : "raw" + std::to_string(sizeof(Value))) + ">";
+        }
+
+        template<typename Visitor>
+        void visit(Visitor &visitor) {
+            visitor.visit(f);
+            visitor.visit(valuesByPosition);
+        }
+    };
+
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "app/host_timer.h"
+#include "mphf_config.h"
+#include "hasher.hpp"
+
+namespace phobicgpu {
+
+    // Takes the place of an MPHF in a super-batch build. Keys arrive already hashed and the
+    // pilots and partition offsets are kept as they are instead of being encoded.
+    struct SuperBatchResult {
+        std::vector<uint32_t> pilots;
+        std::vector<uint32_t> partitionOffsets;
+        std::vector<uint32_t> occupancy;
+        uint64_t occupancyWords = 0;
+
+        constexpr static bool noHash() {
+            return true;
+        }
+
+        template<typename keyType>
+        constexpr static bool deviceHash() {
+            return false;
+        }
+
+        static inline const Key &initialHash(const Key &key) {
+            return key;
+        }
+
+        void setData(const std::vector<uint32_t> &pilots, std::vector<uint32_t> &partitionOffsets,
+                     uint32_t partitions, MPHFconfig config) {
+            this->pilots = pilots;
+            this->partitionOffsets.swap(partitionOffsets);
+        }
+
+        void setPartitionOffsets(std::vector<uint32_t> &partitionOffsets, uint32_t partitions, MPHFconfig config) {
+            this->partitionOffsets.swap(partitionOffsets);
+        }
+
+        void setPilots(const std::vector<uint32_t> &pilots) {
+            this->pilots = pilots;
+        }
+
+        void setOccupancy(const std::vector<uint32_t> &occupancy, uint64_t wordsPerPartition) {
+            this->occupancy = occupancy;
+            occupancyWords = wordsPerPartition;
+        }
+
+        // positions are remapped once all super-batches are stitched together
+        inline uint64_t remapPosition(uint64_t position) const {
+            return position;
+        }
+    };
+
+    // Builds functions for key sets that do not fit into device memory or into a single host vector.
+    // The keys are read in chunks, hashed and distributed into super-batches of consecutive partitions,
+    // optionally spilled to files in spillDirectory. Each super-batch is then built separately by Builder
+    // (MPHFbuilder or CPUMPHFbuilder) and the pilots and partition offsets are stitched together on the host.
+    // The result has the layout of a single build over all keys. Only the partition offsets stitched on the
+    // host are global, so the total number of keys may exceed 2^32 as long as every super-batch stays below.
+    // The keys held on the host are bounded by one chunk and one super-batch, but the pilot encoders take the
+    // pilots of all partitions at once, so the host also holds 4 bytes per bucket and 8 bytes per partition
+    // of the whole function until it is encoded.
+    template<typename Builder>
+    class StreamingMPHFbuilder {
+    private:
+        MPHFconfig config;
+        Builder builder;
+        uint32_t partitionsPerBatch;
+        size_t chunkSize;
+        std::filesystem::path spillDirectory;
+
+        struct SuperBatches {
+            uint32_t partitions;
+            uint32_t partitionsPerBatch;
+            uint32_t batches;
+            std::vector<std::vector<Key>> inMemory;
+            std::vector<std::filesystem::path> files;
+            std::vector<uint64_t> sizes;
+
+            uint32_t partitionsOf(uint32_t batch) const {
+                return std::min(partitionsPerBatch, partitions - batch * partitionsPerBatch);
+            }
+        };
+
+        // the partition of a key is (partitioner * partitions) >> 32, the smallest partitioner
+        // that yields local partition p in a super-batch of localPartitions partitions
+        static inline uint32_t localPartitioner(uint32_t p, uint32_t localPartitions) {
+            return uint32_t(((uint64_t(p) << 32) + localPartitions - 1) / localPartitions);
+        }
+
+        void openBatches(SuperBatches &batches) {
+            batches.sizes.assign(batches.batches, 0);
+            if (spillDirectory.empty()) {
+                batches.inMemory.resize(batches.batches);
+                return;
+            }
+            std::filesystem::create_directories(spillDirectory);
+            for (uint32_t b = 0; b < batches.batches; b++) {
+                batches.files.push_back(spillDirectory / ("superbatch_" + std::to_string(b) + ".keys"));
+                std::ofstream out(batches.files.back(), std::ios::binary | std::ios::trunc);
+                if (!out.good()) {
+                    throw std::runtime_error("failed to create spill file " + batches.files.back().string());
+                }
+            }
+        }
+
+        // hashes a chunk and appends the keys to the super-batches of their partitions
+        template<typename Mphf, typename keyType>
+        void distribute(const std::vector<keyType> &chunk, SuperBatches &batches, std::vector<Key> &hashed,
+                        std::vector<uint32_t> &batchOf, std::vector<Key> &sorted) {
+            hashed.resize(chunk.size());
+            batchOf.resize(chunk.size());
+#pragma omp parallel for
+            for (size_t begin = 0; begin < chunk.size(); begin += HASH_BATCH_SIZE) {
+                size_t end = std::min(begin + HASH_BATCH_SIZE, chunk.size());
+                Mphf::initialHashBatch(chunk.data() + begin, end - begin, hashed.data() + begin);
+                for (size_t i = begin; i < end; i++) {
+                    uint32_t partition = (uint64_t(hashed[i].partitioner) * uint64_t(batches.partitions)) >> 32;
+                    batchOf[i] = partition / batches.partitionsPerBatch;
+                }
+            }
+
+            // counting sort by super-batch such that each batch receives one contiguous write
+            std::vector<size_t> begin(batches.batches + 1, 0);
+            for (uint32_t b: batchOf) {
+                begin[b + 1]++;
+            }
+            std::partial_sum(begin.begin(), begin.end(), begin.begin());
+            sorted.resize(chunk.size());
+            std::vector<size_t> pos(begin.begin(), begin.end() - 1);
+            for (size_t i = 0; i < chunk.size(); i++) {
+                sorted[pos[batchOf[i]]++] = hashed[i];
+            }
+
+            for (uint32_t b = 0; b < batches.batches; b++) {
+                size_t count = begin[b + 1] - begin[b];
+                if (count == 0) continue;
+                batches.sizes[b] += count;
+                if (spillDirectory.empty()) {
+                    batches.inMemory[b].insert(batches.inMemory[b].end(), sorted.begin() + begin[b],
+                                               sorted.begin() + begin[b + 1]);
+                } else {
+                    // the spill files are only open while a chunk is appended, not one per super-batch for
+                    // the whole read
+                    std::ofstream out(batches.files[b], std::ios::binary | std::ios::app);
+                    out.write(reinterpret_cast<const char *>(sorted.data() + begin[b]), sizeof(Key) * count);
+                    if (!out.good()) {
+                        throw std::runtime_error("failed to write spill file " + batches.files[b].string());
+                    }
+                }
+            }
+        }
+
+        std::vector<Key> takeBatch(SuperBatches &batches, uint32_t b) {
+            std::vector<Key> keys;
+            if (spillDirectory.empty()) {
+                keys.swap(batches.inMemory[b]);
+                return keys;
+            }
+            keys.resize(batches.sizes[b]);
+            std::ifstream in(batches.files[b], std::ios::binary);
+            in.read(reinterpret_cast<char *>(keys.data()), sizeof(Key) * keys.size());
+            if (!in.good()) {
+                throw std::runtime_error("failed to read spill file " + batches.files[b].string());
+            }
+            in.close();
+            std::filesystem::remove(batches.files[b]);
+            return keys;
+        }
+
+    public:
+        // partitionsPerBatch bounds the memory of one builder invocation, chunkSize the number of keys
+        // held on the host while reading. Without spillDirectory the super-batches are kept in host memory.
+        StreamingMPHFbuilder(MPHFconfig config, uint32_t partitionsPerBatch, std::filesystem::path spillDirectory = "",
+                             size_t chunkSize = 1 << 24) :
+                config(config),
+                builder(config),
+                partitionsPerBatch(partitionsPerBatch),
+                chunkSize(chunkSize),
+                spillDirectory(spillDirectory) {
+            if (partitionsPerBatch == 0) {
+                throw std::runtime_error("partitionsPerBatch must be positive");
+            }
+        }
+
+        // read(chunk) replaces the content of chunk by at most chunk.capacity() further keys and returns
+        // whether more keys follow. The number of keys n has to be known in advance because it
+        // determines the partitioning.
+        template<typename Mphf, typename keyType, typename Reader>
+        HostTimer build(Reader &&read, uint64_t n, Mphf &f) {
+            uint64_t partitions = std::max<uint64_t>(1, (n + config.partitionSize - 1) / config.partitionSize);
+            if (partitions > std::numeric_limits<uint32_t>::max()) {
+                throw std::runtime_error("too many keys");
+            }
+            HostTimer totalTimer;
+            SuperBatches batches;
+            batches.partitions = partitions;
+            batches.partitionsPerBatch = partitionsPerBatch;
+            batches.batches = (batches.partitions + partitionsPerBatch - 1) / partitionsPerBatch;
+            openBatches(batches);
+
+            std::vector<keyType> chunk;
+            chunk.reserve(chunkSize);
+            std::vector<Key> hashed;
+            std::vector<uint32_t> batchOf;
+            std::vector<Key> sorted;
+            uint64_t readKeys = 0;
+            while (read(chunk)) {
+                readKeys += chunk.size();
+                distribute<Mphf>(chunk, batches, hashed, batchOf, sorted);
+            }
+            readKeys += chunk.size();
+            distribute<Mphf>(chunk, batches, hashed, batchOf, sorted);
+            if (readKeys != n) {
+                throw std::runtime_error("read " + std::to_string(readKeys) + " keys instead of " + std::to_string(n));
+            }
+            std::vector<Key>().swap(hashed);
+            std::vector<Key>().swap(sorted);
+            totalTimer.addLabel("streaming_distribution");
+
+            uint32_t buckets = config.bucketCountPerPartition;
+            std::vector<uint32_t> pilots(size_t(batches.partitions) * buckets);
+            std::vector<uint64_t> partitionOffsets(batches.partitions + 1, 0);
+            // occupied positions of each super-batch for a remapped load factor below 1, the builders may
+            // use bitmaps of different widths
+            std::vector<std::vector<uint32_t>> occupancy(batches.batches);
+            std::vector<uint64_t> occupancyWords(batches.batches, 0);
+            for (uint32_t b = 0; b < batches.batches; b++) {
+                uint32_t first = b * partitionsPerBatch;
+                uint32_t localPartitions = batches.partitionsOf(b);
+                std::vector<Key> keys = takeBatch(batches, b);
+#pragma omp parallel for
+                for (size_t i = 0; i < keys.size(); i++) {
+                    uint32_t partition = (uint64_t(keys[i].partitioner) * uint64_t(batches.partitions)) >> 32;
+                    keys[i].partitioner = localPartitioner(partition - first, localPartitions);
+                }
+
+                SuperBatchResult result;
+                builder.build(keys, result, localPartitions);
+
+                for (uint32_t bucket = 0; bucket < buckets; bucket++) {
+                    std::copy_n(result.pilots.begin() + size_t(bucket) * localPartitions, localPartitions,
+                                pilots.begin() + size_t(bucket) * batches.partitions + first);
+                }
+                for (uint32_t p = 0; p < localPartitions; p++) {
+                    partitionOffsets[first + p + 1] = partitionOffsets[first] + result.partitionOffsets[p + 1];
+                }
+                occupancy[b].swap(result.occupancy);
+                occupancyWords[b] = result.occupancyWords;
+                totalTimer.addLabel("superbatch_" + std::to_string(b));
+            }
+
+            f.setData(pilots, partitionOffsets, batches.partitions, config);
+            if (config.remapped() && batches.batches != 0) {
+                uint64_t words = *std::max_element(occupancyWords.begin(), occupancyWords.end());
+                std::vector<uint32_t> stitched(words * batches.partitions, 0);
+                for (uint32_t b = 0; b < batches.batches; b++) {
+                    for (uint64_t p = 0; p < batches.partitionsOf(b); p++) {
+                        std::copy_n(occupancy[b].begin() + p * occupancyWords[b], occupancyWords[b],
+                                    stitched.begin() + (uint64_t(b) * partitionsPerBatch + p) * words);
+                    }
+                }
+                f.setOccupancy(stitched, words);
+            }
+            totalTimer.addLabel("encoding");
+            return totalTimer;
+        }
+
+        template<typename Mphf, typename Iterator>
+        HostTimer build(Iterator begin, Iterator end, Mphf &f) {
+            typedef typename std::iterator_traits<Iterator>::value_type keyType;
+            uint64_t n = std::distance(begin, end);
+            auto read = [&](std::vector<keyType> &chunk) {
+                chunk.clear();
+                while (begin != end && chunk.size() < chunk.capacity()) {
+                    chunk.push_back(*begin);
+                    ++begin;
+                }
+                return begin != end;
+            };
+            return build<Mphf, keyType>(read, n, f);
+        }
+    };
+}
@@ -5,6 +5,7 @@
 #include "encoders/pilotEncoders/mono_encoders.hpp"
 #include "encoders/pilotEncoders/interleaved_encoder.hpp"
 #include "encoders/pilotEncoders/interleaved_encoder_dual.hpp"
+#include "encoders/pilotEncoders/flat_interleaved_encoder.hpp"
 
 #include "encoders/partitionOffsetEnocders/direct_partition_offset_encoder.hpp"
 #include "encoders/partitionOffsetEnocders/diff_partition_offset_encoder.hpp"
@@ -12,6 +13,12 @@
 
 #include "phobicGpu/mphf.hpp"
 #include "phobicGpu/mphf_builder.h"
+#include "phobicGpu/cpu_builder.h"
+#include "phobicGpu/serialization.hpp"
+#include "phobicGpu/streaming_builder.h"
+#include "phobicGpu/device_mphf.h"
+#include "phobicGpu/static_map.hpp"
+#include "phobicGpu/fingerprint_mphf.hpp"
 
 #include "phobicGpu/hasher.hpp"
 
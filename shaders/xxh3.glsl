@@ -0,0 +1,271 @@
+// Port of XXH3_128bits with seed 0 (XXH128(data, len, 0)) from xxHash 0.8, bit for bit equal to the host hashes.
+// The including shader defines the input as byte positions in its own buffer:
+//   uint xxhReadByte(uint pos);
+//   uint xxhReadLE32(uint pos);
+//   uint64_t xxhReadLE64(uint pos);
+// It also enables GL_EXT_shader_explicit_arithmetic_types_int64, which requires the shaderInt64 device feature.
+
+#define XXH_PRIME32_1 0x9E3779B1u
+#define XXH_PRIME32_2 0x85EBCA77u
+#define XXH_PRIME32_3 0xC2B2AE3Du
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ul
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4Ful
+#define XXH_PRIME64_3 0x165667B19E3779F9ul
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ul
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ul
+#define XXH_PRIME_MX1 0x165667919E3779F9ul
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ul
+
+#define XXH_SECRET_SIZE 192u
+#define XXH_STRIPE_LEN 64u
+#define XXH_STRIPES_PER_BLOCK 16u
+#define XXH_MIDSIZE_MAX 240u
+
+// default secret, little endian words
+const uint XXH3_SECRET[48] = uint[](
+        0x396cfeb8u, 0xbe4ba423u, 0x2c81017cu, 0x1cad21f7u, 0xe96dd4deu, 0xdb979083u, 0xa4a44072u, 0x1f67b3b7u,
+        0x4ee679cbu, 0x78e5c0ccu, 0x7dd05a82u, 0x2172ffccu, 0x744608b8u, 0x8e2443f7u, 0xe69035e0u, 0x4c263a81u,
+        0xbb52283cu, 0xcb00c391u, 0x8b65d088u, 0xa32e531bu, 0x97486471u, 0x4ef90da2u, 0x46ef1938u, 0xd8acdea9u,
+        0x3f76faa8u, 0x3f349ce3u, 0xc7bbdcf9u, 0x1d4f0bc7u, 0x4be0518au, 0x3159b4cdu, 0xc97e9fc8u, 0x647378d9u,
+        0x83acc5eau, 0xc3ebd334u, 0xffa081c5u, 0xeb6313fau, 0x51dd0d17u, 0x49daf0b7u, 0x265516d3u, 0x9e68d429u,
+        0x58be162bu, 0xfca1477du, 0xd1b8f88fu, 0xce31d07au, 0x8f3acb45u, 0x28041695u, 0xcafbd7afu, 0x7e404bbbu
+);
+
+struct Hash128 {
+    uint64_t low;
+    uint64_t high;
+};
+
+uint xxhSecret32(uint pos) {
+    uint shift = (pos & 3u) * 8u;
+    uint lo = XXH3_SECRET[pos >> 2];
+    if (shift == 0u) {
+        return lo;
+    }
+    return (lo >> shift) | (XXH3_SECRET[(pos >> 2) + 1u] << (32u - shift));
+}
+
+uint64_t xxhSecret64(uint pos) {
+    return uint64_t(xxhSecret32(pos)) | (uint64_t(xxhSecret32(pos + 4u)) << 32);
+}
+
+Hash128 xxhMult64to128(uint64_t lhs, uint64_t rhs) {
+    uint64_t loLo = (lhs & 0xFFFFFFFFul) * (rhs & 0xFFFFFFFFul);
+    uint64_t hiLo = (lhs >> 32) * (rhs & 0xFFFFFFFFul);
+    uint64_t loHi = (lhs & 0xFFFFFFFFul) * (rhs >> 32);
+    uint64_t hiHi = (lhs >> 32) * (rhs >> 32);
+    uint64_t cross = (loLo >> 32) + (hiLo & 0xFFFFFFFFul) + loHi;
+    Hash128 product;
+    product.high = (hiLo >> 32) + (cross >> 32) + hiHi;
+    product.low = (cross << 32) | (loLo & 0xFFFFFFFFul);
+    return product;
+}
+
+uint64_t xxhMul128Fold64(uint64_t lhs, uint64_t rhs) {
+    Hash128 product = xxhMult64to128(lhs, rhs);
+    return product.low ^ product.high;
+}
+
+uint64_t xxh64Avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t xxh3Avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+uint xxhSwap32(uint x) {
+    return (x << 24) | ((x << 8) & 0x00ff0000u) | ((x >> 8) & 0x0000ff00u) | (x >> 24);
+}
+
+uint64_t xxhSwap64(uint64_t x) {
+    return (uint64_t(xxhSwap32(uint(x))) << 32) | uint64_t(xxhSwap32(uint(x >> 32)));
+}
+
+Hash128 xxh3Len4to8(uint64_t input64, uint len) {
+    uint64_t bitflip = xxhSecret64(16u) ^ xxhSecret64(24u);
+    uint64_t keyed = input64 ^ bitflip;
+    Hash128 m = xxhMult64to128(keyed, XXH_PRIME64_1 + (uint64_t(len) << 2));
+    m.high += m.low << 1;
+    m.low ^= m.high >> 3;
+    m.low ^= m.low >> 35;
+    m.low *= XXH_PRIME_MX2;
+    m.low ^= m.low >> 28;
+    m.high = xxh3Avalanche(m.high);
+    return m;
+}
+
+Hash128 xxh3Len0to16(uint input, uint len) {
+    Hash128 h;
+    if (len > 8u) {
+        uint64_t bitflipl = xxhSecret64(32u) ^ xxhSecret64(40u);
+        uint64_t bitfliph = xxhSecret64(48u) ^ xxhSecret64(56u);
+        uint64_t inputLo = xxhReadLE64(input);
+        uint64_t inputHi = xxhReadLE64(input + len - 8u);
+        Hash128 m = xxhMult64to128(inputLo ^ inputHi ^ bitflipl, XXH_PRIME64_1);
+        m.low += uint64_t(len - 1u) << 54;
+        inputHi ^= bitfliph;
+        m.high += inputHi + (inputHi & 0xFFFFFFFFul) * uint64_t(XXH_PRIME32_2 - 1u);
+        m.low ^= xxhSwap64(m.high);
+        h = xxhMult64to128(m.low, XXH_PRIME64_2);
+        h.high += m.high * XXH_PRIME64_2;
+        h.low = xxh3Avalanche(h.low);
+        h.high = xxh3Avalanche(h.high);
+    } else if (len >= 4u) {
+        uint64_t input64 = uint64_t(xxhReadLE32(input)) | (uint64_t(xxhReadLE32(input + len - 4u)) << 32);
+        h = xxh3Len4to8(input64, len);
+    } else if (len > 0u) {
+        uint c1 = xxhReadByte(input);
+        uint c2 = xxhReadByte(input + (len >> 1));
+        uint c3 = xxhReadByte(input + len - 1u);
+        uint combinedl = (c1 << 16) | (c2 << 24) | c3 | (len << 8);
+        uint swapped = xxhSwap32(combinedl);
+        uint combinedh = (swapped << 13) | (swapped >> 19);
+        uint64_t bitflipl = uint64_t(xxhSecret32(0u) ^ xxhSecret32(4u));
+        uint64_t bitfliph = uint64_t(xxhSecret32(8u) ^ xxhSecret32(12u));
+        h.low = xxh64Avalanche(uint64_t(combinedl) ^ bitflipl);
+        h.high = xxh64Avalanche(uint64_t(combinedh) ^ bitfliph);
+    } else {
+        h.low = xxh64Avalanche(xxhSecret64(64u) ^ xxhSecret64(72u));
+        h.high = xxh64Avalanche(xxhSecret64(80u) ^ xxhSecret64(88u));
+    }
+    return h;
+}
+
+uint64_t xxh3Mix16B(uint input, uint secret) {
+    return xxhMul128Fold64(xxhReadLE64(input) ^ xxhSecret64(secret),
+                           xxhReadLE64(input + 8u) ^ xxhSecret64(secret + 8u));
+}
+
+Hash128 xxh3Mix32B(Hash128 acc, uint input1, uint input2, uint secret) {
+    acc.low += xxh3Mix16B(input1, secret);
+    acc.low ^= xxhReadLE64(input2) + xxhReadLE64(input2 + 8u);
+    acc.high += xxh3Mix16B(input2, secret + 16u);
+    acc.high ^= xxhReadLE64(input1) + xxhReadLE64(input1 + 8u);
+    return acc;
+}
+
+Hash128 xxh3MidsizeFinish(Hash128 acc, uint len) {
+    Hash128 h;
+    h.low = acc.low + acc.high;
+    h.high = acc.low * XXH_PRIME64_1 + acc.high * XXH_PRIME64_4 + uint64_t(len) * XXH_PRIME64_2;
+    h.low = xxh3Avalanche(h.low);
+    h.high = 0ul - xxh3Avalanche(h.high);
+    return h;
+}
+
+Hash128 xxh3Len17to128(uint input, uint len) {
+    Hash128 acc;
+    acc.low = uint64_t(len) * XXH_PRIME64_1;
+    acc.high = 0ul;
+    if (len > 32u) {
+        if (len > 64u) {
+            if (len > 96u) {
+                acc = xxh3Mix32B(acc, input + 48u, input + len - 64u, 96u);
+            }
+            acc = xxh3Mix32B(acc, input + 32u, input + len - 48u, 64u);
+        }
+        acc = xxh3Mix32B(acc, input + 16u, input + len - 32u, 32u);
+    }
+    acc = xxh3Mix32B(acc, input, input + len - 16u, 0u);
+    return xxh3MidsizeFinish(acc, len);
+}
+
+Hash128 xxh3Len129to240(uint input, uint len) {
+    Hash128 acc;
+    acc.low = uint64_t(len) * XXH_PRIME64_1;
+    acc.high = 0ul;
+    for (uint i = 32u; i < 160u; i += 32u) {
+        acc = xxh3Mix32B(acc, input + i - 32u, input + i - 16u, i - 32u);
+    }
+    acc.low = xxh3Avalanche(acc.low);
+    acc.high = xxh3Avalanche(acc.high);
+    // duplicates the last 32 bytes for multiples of 32 like the reference
+    for (uint i = 160u; i <= len; i += 32u) {
+        acc = xxh3Mix32B(acc, input + i - 32u, input + i - 16u, 3u + i - 160u);
+    }
+    acc = xxh3Mix32B(acc, input + len - 16u, input + len - 32u, 136u - 17u - 16u);
+    return xxh3MidsizeFinish(acc, len);
+}
+
+uint64_t xxh3MergeAccs(uint64_t acc0, uint64_t acc1, uint64_t acc2, uint64_t acc3, uint64_t acc4,
+                       uint64_t acc5, uint64_t acc6, uint64_t acc7, uint secret, uint64_t start) {
+    uint64_t result = start;
+    result += xxhMul128Fold64(acc0 ^ xxhSecret64(secret), acc1 ^ xxhSecret64(secret + 8u));
+    result += xxhMul128Fold64(acc2 ^ xxhSecret64(secret + 16u), acc3 ^ xxhSecret64(secret + 24u));
+    result += xxhMul128Fold64(acc4 ^ xxhSecret64(secret + 32u), acc5 ^ xxhSecret64(secret + 40u));
+    result += xxhMul128Fold64(acc6 ^ xxhSecret64(secret + 48u), acc7 ^ xxhSecret64(secret + 56u));
+    return xxh3Avalanche(result);
+}
+
+Hash128 xxh3HashLong(uint input, uint len) {
+    uint64_t acc[8];
+    acc[0] = uint64_t(XXH_PRIME32_3);
+    acc[1] = XXH_PRIME64_1;
+    acc[2] = XXH_PRIME64_2;
+    acc[3] = XXH_PRIME64_3;
+    acc[4] = XXH_PRIME64_4;
+    acc[5] = uint64_t(XXH_PRIME32_2);
+    acc[6] = XXH_PRIME64_5;
+    acc[7] = uint64_t(XXH_PRIME32_1);
+
+    uint blockLen = XXH_STRIPE_LEN * XXH_STRIPES_PER_BLOCK;
+    uint blocks = (len - 1u) / blockLen;
+    uint stripes = blocks * XXH_STRIPES_PER_BLOCK + ((len - 1u) - blockLen * blocks) / XXH_STRIPE_LEN;
+    // the stripes of all blocks and the last partial block, followed by the last stripe
+    for (uint s = 0u; s <= stripes; s++) {
+        uint stripeInput = s < stripes ? input + s * XXH_STRIPE_LEN : input + len - XXH_STRIPE_LEN;
+        uint secret = s < stripes ? (s % XXH_STRIPES_PER_BLOCK) * 8u : XXH_SECRET_SIZE - XXH_STRIPE_LEN - 7u;
+        for (uint lane = 0u; lane < 8u; lane++) {
+            uint64_t dataVal = xxhReadLE64(stripeInput + lane * 8u);
+            uint64_t dataKey = dataVal ^ xxhSecret64(secret + lane * 8u);
+            acc[lane ^ 1u] += dataVal;
+            acc[lane] += (dataKey & 0xFFFFFFFFul) * (dataKey >> 32);
+        }
+        // scramble after each full block
+        if (s < stripes && s % XXH_STRIPES_PER_BLOCK == XXH_STRIPES_PER_BLOCK - 1u
+            && s / XXH_STRIPES_PER_BLOCK < blocks) {
+            for (uint lane = 0u; lane < 8u; lane++) {
+                uint64_t a = acc[lane];
+                a ^= a >> 47;
+                a ^= xxhSecret64(XXH_SECRET_SIZE - XXH_STRIPE_LEN + lane * 8u);
+                a *= uint64_t(XXH_PRIME32_1);
+                acc[lane] = a;
+            }
+        }
+    }
+
+    Hash128 h;
+    h.low = xxh3MergeAccs(acc[0], acc[1], acc[2], acc[3], acc[4], acc[5], acc[6], acc[7],
+                          11u, uint64_t(len) * XXH_PRIME64_1);
+    h.high = xxh3MergeAccs(acc[0], acc[1], acc[2], acc[3], acc[4], acc[5], acc[6], acc[7],
+                           XXH_SECRET_SIZE - 64u - 11u, ~(uint64_t(len) * XXH_PRIME64_2));
+    return h;
+}
+
+// XXH128 of the len bytes at input
+Hash128 xxh3Hash128(uint input, uint len) {
+    if (len <= 16u) {
+        return xxh3Len0to16(input, len);
+    }
+    if (len <= 128u) {
+        return xxh3Len17to128(input, len);
+    }
+    if (len <= XXH_MIDSIZE_MAX) {
+        return xxh3Len129to240(input, len);
+    }
+    return xxh3HashLong(input, len);
+}
+
+// XXH128 of the 8 bytes of an integer key
+Hash128 xxh3Hash128(uint64_t key) {
+    return xxh3Len4to8(key, 8u);
+}
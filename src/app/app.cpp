@@ -1,4 +1,10 @@
+#include <unistd.h>
+
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <set>
 
@@ -204,9 +210,35 @@ static uint32_t getSubgroupSize(vk::PhysicalDevice pDevice) {
 }
 
 
+static bool supportsCalibratedTimestamps(const vk::Instance &instance, const vk::PhysicalDevice &pDevice) {
+    if (!checkDeviceExtensionSupport(pDevice, {VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME})) {
+        return false;
+    }
+    auto getTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+            instance.getProcAddr("vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+    if (getTimeDomains == nullptr) {
+        return false;
+    }
+    uint32_t domainCount = 0;
+    getTimeDomains(static_cast<VkPhysicalDevice>(pDevice), &domainCount, nullptr);
+    std::vector<VkTimeDomainEXT> domains(domainCount);
+    getTimeDomains(static_cast<VkPhysicalDevice>(pDevice), &domainCount, domains.data());
+    return std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end() &&
+           std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT) != domains.end();
+}
+
+static bool supportsHostQueryReset(const vk::PhysicalDevice &pDevice) {
+    vk::PhysicalDeviceVulkan12Features vulkan12Features{};
+    vk::PhysicalDeviceFeatures2 features2{};
+    features2.pNext = &vulkan12Features;
+    pDevice.getFeatures2(&features2);
+    return vulkan12Features.hostQueryReset;
+}
+
 static vk::Device createLogicalDevice(
         const AppConfiguration &config, const QueueFamilyIndices &indices,
-        const vk::Instance &instance, const vk::PhysicalDevice &pDevice) {
+        const vk::Instance &instance, const vk::PhysicalDevice &pDevice,
+        bool calibratedTimestamps, bool hostQueryReset) {
 
     // TODO: we need to assign individual queue priorities in the future
     const float queuePriority = 1.0f;
@@ -229,10 +261,16 @@ static vk::Device createLogicalDevice(
 
     vk::PhysicalDeviceVulkan11Features vulkan11Features{};
     vulkan11Features.shaderDrawParameters = true;
-    vulkan11Features.pNext = nullptr;
+
+    vk::PhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.hostQueryReset = hostQueryReset;
+    vulkan11Features.pNext = &vulkan12Features;
 
 
+    vk::PhysicalDeviceFeatures supportedFeatures;
+    pDevice.getFeatures(&supportedFeatures);
     vk::PhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.shaderInt64 = supportedFeatures.shaderInt64;
 
 
     vk::DeviceCreateInfo createInfo{};
@@ -243,8 +281,12 @@ static vk::Device createLogicalDevice(
     createInfo.pNext = &vulkan11Features;
 
     // enable extensions
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(REQUIRED_DEVICE_EXTENSIONS.size());
-    createInfo.ppEnabledExtensionNames = REQUIRED_DEVICE_EXTENSIONS.data();
+    std::vector<const char *> extensions(REQUIRED_DEVICE_EXTENSIONS);
+    if (calibratedTimestamps) {
+        extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     // optionally enable validation layers in debug mode
     // it is usually enough to do it for the physical device but we do it anyways
@@ -268,21 +310,112 @@ static vk::CommandPool createCommandPool(const vk::Device &device, uint32_t inde
     return CHECK(device.createCommandPool(poolInfo), "failed to create command pool");
 }
 
+// $PHOBIC_GPU_PIPELINE_CACHE or a file in the user cache directory, empty if pipelines are not cached on disk
+static std::string getPipelineCachePath() {
+    if (const char *path = std::getenv("PHOBIC_GPU_PIPELINE_CACHE")) {
+        return path;
+    }
+    if (const char *cacheHome = std::getenv("XDG_CACHE_HOME"); cacheHome != nullptr && *cacheHome != 0) {
+        return std::string(cacheHome) + "/phobic-gpu/pipeline_cache.bin";
+    }
+    if (const char *home = std::getenv("HOME"); home != nullptr && *home != 0) {
+        return std::string(home) + "/.cache/phobic-gpu/pipeline_cache.bin";
+    }
+    return "";
+}
+
+// only data of the same driver and device is handed to Vulkan
+static bool isPipelineCacheCompatible(const std::vector<char> &data, const vk::PhysicalDevice &pDevice) {
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    vk::PhysicalDeviceProperties properties = pDevice.getProperties();
+    return header.headerSize >= sizeof(header) &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties.vendorID &&
+           header.deviceID == properties.deviceID &&
+           std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
+
+static vk::PipelineCache createPipelineCache(const vk::Device &device, const vk::PhysicalDevice &pDevice,
+                                             const std::string &path) {
+    std::vector<char> data;
+    if (!path.empty()) {
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if (file.is_open()) {
+            data.resize(size_t(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), data.size());
+            if (!file.good() || !isPipelineCacheCompatible(data, pDevice)) {
+                data.clear();
+            }
+        }
+    }
+    vk::PipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.data();
+    return CHECK(device.createPipelineCache(cacheInfo), "failed to create pipeline cache");
+}
+
+// Written to a temporary file that replaces the cache, such that concurrent processes never read a partial file.
+// Failures are ignored, the cache only saves time.
+static void storePipelineCache(const vk::Device &device, const vk::PipelineCache &cache, const std::string &path) {
+    if (path.empty()) {
+        return;
+    }
+    auto data = device.getPipelineCacheData(cache);
+    if (data.result != vk::Result::eSuccess) {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::path target(path);
+    if (target.has_parent_path()) {
+        std::filesystem::create_directories(target.parent_path(), error);
+    }
+    std::filesystem::path temporary = target;
+    temporary += "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(data.value.data()), data.value.size());
+    file.close();
+    if (!file.good()) {
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+    std::filesystem::rename(temporary, target, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+    }
+}
+
 App::App() {
     AppConfiguration config;
 
     instance = createInstance(config);
     pDevice = pickPhysicalDevice(instance);
     subGroupSize = getSubgroupSize(pDevice);
+    shaderInt64 = pDevice.getFeatures().shaderInt64;
 
     indices = findQueueFamilies(pDevice);
-    device = createLogicalDevice(config, indices, instance, pDevice);
+    calibratedTimestamps = supportsCalibratedTimestamps(instance, pDevice);
+    bool hostQueryReset = supportsHostQueryReset(pDevice);
+    device = createLogicalDevice(config, indices, instance, pDevice, calibratedTimestamps, hostQueryReset);
+    if (calibratedTimestamps) {
+        getCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+                device.getProcAddr("vkGetCalibratedTimestampsEXT"));
+    }
+    transferTimestamps = hostQueryReset &&
+                         pDevice.getQueueFamilyProperties()[indices.transferFamily.value()].timestampValidBits > 0;
     transferQueue = device.getQueue(indices.transferFamily.value(), 0);
     computeQueue = device.getQueue(indices.computeFamily.value(), 0);
 
     transferCommandPool = createCommandPool(device, indices.transferFamily.value());
     computeCommandPool = createCommandPool(device, indices.computeFamily.value());
 
+    pipelineCachePath = getPipelineCachePath();
+    pipelineCache = createPipelineCache(device, pDevice, pipelineCachePath);
+
     memoryAlloc = MemoryAllocator(pDevice, device, indices,
                                   transferQueue, transferCommandPool);
 
@@ -299,7 +432,10 @@ App::~App() {
         shader->destroy(device);
         delete shader;
     }
+    storePipelineCache(device, pipelineCache, pipelineCachePath);
+    device.destroyPipelineCache(pipelineCache);
     descrAlloc.destroy();
+    memoryAlloc.destroy();
     device.destroyCommandPool(transferCommandPool);
     device.destroyCommandPool(computeCommandPool);
     device.destroy();
@@ -344,6 +480,42 @@ CommandBuffer *App::createCommandBuffer() {
     return new CommandBuffer(device, computeCommandPool);
 }
 
+TimestampCalibration App::calibrateTimestamps() {
+    TimestampCalibration calibration;
+    calibration.period = pDevice.getProperties().limits.timestampPeriod;
+    if (getCalibratedTimestamps != nullptr) {
+        VkCalibratedTimestampInfoEXT infos[2] = {};
+        infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+        infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+        uint64_t timestamps[2];
+        uint64_t maxDeviation;
+        if (getCalibratedTimestamps(static_cast<VkDevice>(device), 2, infos, timestamps, &maxDeviation) ==
+            VK_SUCCESS) {
+            calibration.deviceTicks = timestamps[0];
+            calibration.hostTime = timestamps[1];
+            return calibration;
+        }
+    }
+
+    CommandBuffer *cb = createCommandBuffer();
+    TimestampCreateInfo createInfo;
+    TimestampHandle handle = createInfo.addTimestamp({"calibration"});
+    cb->attachTimestamps(device, createInfo);
+    cb->begin();
+    cb->writeTimeStamp(handle);
+    uint64_t before = Trace::now();
+    cb->submit(device, computeQueue, true);
+    uint64_t after = Trace::now();
+    cb->readTimestamps(device, pDevice);
+    calibration.deviceTicks = cb->getTimestamps()[0].ticks;
+    calibration.hostTime = before + (after - before) / 2;
+    cb->destroy(device, computeCommandPool);
+    delete cb;
+    return calibration;
+}
+
 
 const ShaderStage *App::computeStage(
         const Shader *shader,
@@ -358,6 +530,7 @@ const ShaderStage *App::computeStage(
     ComputePipelineBuilder builder(shader);
     for (const vk::DescriptorSetLayout &layout: layouts) builder.addDescriptorSetLayout(layout);
     for (const vk::PushConstantRange &r: pushRanges) builder.addPushConstantRange(r);
+    builder.setPipelineCache(pipelineCache);
     Pipeline pipeline = builder.buildSpecialization(device, specMap, specData, specDataSize);
 
     stages.push_back(new ShaderStage(pipeline, layouts));
@@ -32,7 +32,12 @@ void CommandBuffer::destroy(const vk::Device &device, const vk::CommandPool &com
     // release allocator
     descrAlloc.destroy();
 
+    if (pendingFence) {
+        device.destroy(pendingFence);
+    }
+
     device.destroyQueryPool(timestampPool);
+    device.freeCommandBuffers(commandPool, primaryBuffer);
 }
 
 void CommandBuffer::bindComputePipeline(const vk::Pipeline &pipeline) {
@@ -67,6 +72,19 @@ void CommandBuffer::readWritePipelineBarrier() {
                     {vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead)}, {}, {});
 }
 
+void CommandBuffer::transferComputeBarrier() {
+    pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+                    vk::DependencyFlags(),
+                    {vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite,
+                                       vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)}, {}, {});
+}
+
+void CommandBuffer::transferHostBarrier() {
+    pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+                    vk::DependencyFlags(),
+                    {vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead)}, {}, {});
+}
+
 void CommandBuffer::bindComputeDescriptorSet(const vk::PipelineLayout &layout, const vk::DescriptorSet &set,
                                              const uint32_t setNumber) {
     primaryBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, setNumber,
@@ -81,28 +99,45 @@ void CommandBuffer::bindComputeDescriptorSet(const Pipeline &pipeline, const Des
 
 
 void CommandBuffer::submit(const vk::Device &device, const vk::Queue &queue, const bool wait) {
-    CHECK(primaryBuffer.end(), "ending buffer failed");
-    vk::Fence fence;
-    if(wait) {
-        fence = createFence(device);
+    if (recording) {
+        CHECK(primaryBuffer.end(), "ending buffer failed");
+        recording = false;
+    }
+    // the buffer may not be pending twice, and its fence must not be dropped without being waited for
+    if (pendingFence) {
+        this->wait(device);
     }
-    CHECK(queue.submit({vk::SubmitInfo(0, nullptr, nullptr, 1, &primaryBuffer)}, fence), "failed to submit to queue!");
+    pendingFence = createFence(device);
+    CHECK(queue.submit({vk::SubmitInfo(0, nullptr, nullptr, 1, &primaryBuffer)}, pendingFence),
+          "failed to submit to queue!");
     if(wait) {
-        CHECK(device.waitForFences({fence},true,-1), "wait for fence failed");
-        device.destroy(fence);
+        this->wait(device);
     }
 }
 
-void CommandBuffer::begin() {
-    vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+void CommandBuffer::wait(const vk::Device &device) {
+    CHECK(bool(pendingFence), "no pending submission");
+    CHECK(device.waitForFences({pendingFence},true,-1), "wait for fence failed");
+    device.destroy(pendingFence);
+    pendingFence = vk::Fence();
+}
+
+void CommandBuffer::begin(bool reusable) {
+    vk::CommandBufferBeginInfo beginInfo(reusable ? vk::CommandBufferUsageFlags()
+                                                  : vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
     CHECK(primaryBuffer.begin(beginInfo), "beginning buffer failed");
-    primaryBuffer.resetQueryPool(timestampPool, 0, timestampsInfo.size());
+    recording = true;
+    if (timestampPool) {
+        primaryBuffer.resetQueryPool(timestampPool, 0, timestampsInfo.size());
+    }
 }
 
 
 void CommandBuffer::attachTimestamps(const vk::Device &device, TimestampCreateInfo createInfo) {
-    // reset
-    //device.destroyQueryPool(timestampPool);
+    // re-recorded buffers replace their timestamps
+    if (timestampPool) {
+        device.destroyQueryPool(timestampPool);
+    }
 
     timestampsInfo = createInfo;
     vk::QueryPoolCreateInfo poolCreateInfo({}, vk::QueryType::eTimestamp, createInfo.size());
@@ -125,17 +160,23 @@ void CommandBuffer::readTimestamps(const vk::Device &device, const vk::PhysicalD
     std::vector<TimestampResult> res;
     for (uint32_t i = 0; i < timestampsInfo.size(); i++) {
         res.push_back(TimestampResult{TimestampHandle{timestampsInfo.get(i), i},
-                                      properties.limits.timestampPeriod * (timestamps[i] - timestamps[0])});
+                                      properties.limits.timestampPeriod * (timestamps[i] - timestamps[0]),
+                                      timestamps[i]});
     }
     lastRead = res;
     delete[] timestamps;
 }
 
-void CommandBuffer::copyBuffer(vk::Buffer src, vk::Buffer dst, vk::DeviceSize byteSize) {
-    vk::BufferCopy copyRegion(0ULL, 0ULL, byteSize);
+void CommandBuffer::copyBuffer(vk::Buffer src, vk::Buffer dst, vk::DeviceSize byteSize, vk::DeviceSize srcOffset,
+                               vk::DeviceSize dstOffset) {
+    vk::BufferCopy copyRegion(srcOffset, dstOffset, byteSize);
     primaryBuffer.copyBuffer(src, dst, 1, &copyRegion);
 }
 
+void CommandBuffer::fillBuffer(vk::Buffer dst, vk::DeviceSize byteSize, uint32_t value) {
+    primaryBuffer.fillBuffer(dst, 0ULL, byteSize, value);
+}
+
 std::vector<TimestampResult> CommandBuffer::getTimestamps() {
     return lastRead;
 }
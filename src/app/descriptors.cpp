@@ -179,6 +179,8 @@ void DescriptorAllocator::reset() {
     for (const vk::DescriptorPool &pool: pools) {
         device.resetDescriptorPool(pool);
     }
+    poolIndex = 0;
+    currentPoolOffset = 0;
 }
 
 void DescriptorAllocator::destroy() {
@@ -1,4 +1,5 @@
 #include "app/host_timer.h"
+#include "app/trace.h"
 #include <iostream>
 
 HostTimer::HostTimer() {
@@ -7,16 +8,40 @@ HostTimer::HostTimer() {
 
 void HostTimer::reset() {
     start = clock::now();
+    lastLabel = 0;
+}
+
+void HostTimer::attachTrace(Trace *trace) {
+    this->trace = trace;
+}
+
+uint64_t HostTimer::traceTime(double time) const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count() + uint64_t(time);
 }
 
 void HostTimer::addLabel(std::string name) {
-    labels.push_back({elapsed(), name});
+    double now = elapsed();
+    if (trace != nullptr) {
+        trace->add(Trace::eHost, name, traceTime(lastLabel), traceTime(now));
+    }
+    labels.push_back({now, name});
+    lastLabel = now;
 }
 
 void HostTimer::addLabelManually(std::string name, double time) {
     labels.push_back({time, name});
 }
 
+void HostTimer::addMeasurement(std::string name, double time) {
+    measurements.push_back({time, name});
+}
+
+void HostTimer::addSpan(std::string name, double begin, double end) {
+    if (trace != nullptr) {
+        trace->add(Trace::eHost, name, traceTime(begin), traceTime(end));
+    }
+}
+
 void HostTimer::printLabels(double div) const {
     double last = 0;
     for (const Label &l: labels) {
@@ -25,6 +50,9 @@ void HostTimer::printLabels(double div) const {
         std::cout << diff / div << " " << now / div << " " << l.name << std::endl;
         last = now;
     }
+    for (const Label &m: measurements) {
+        std::cout << m.time / div << " " << m.name << std::endl;
+    }
 }
 
 double HostTimer::elapsed() const {
@@ -42,5 +70,8 @@ std::string HostTimer::getResultStyle(double div) const {
         res += l.name + "=" + std::to_string(diff / div) + " ";
         last = now;
     }
+    for (const Label &m: measurements) {
+        res += m.name + "=" + std::to_string(m.time / div) + " ";
+    }
     return res;
 }
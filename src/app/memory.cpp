@@ -1,8 +1,19 @@
+#include <algorithm>
+#include <cstring>
 #include <functional>
+#include <iterator>
 
 #include "app/memory.h"
 #include "app/check.h"
 
+// small buffers are carved from blocks of this size, larger ones get dedicated memory
+static const vk::DeviceSize MEMORY_BLOCK_SIZE = 64 << 20;
+static const vk::DeviceSize SUBALLOCATION_LIMIT = MEMORY_BLOCK_SIZE / 4;
+
+static const size_t STAGING_RING_SLOTS = 3;
+// upload() and download() transfer in parts of this size
+static const size_t STAGING_CHUNK_SIZE = 8 << 20;
+
 static vk::CommandBuffer allocateBuffer(
         const vk::Device &device,
         const vk::CommandPool &commandPool) {
@@ -25,9 +36,57 @@ MemoryAllocator::MemoryAllocator(
         pDevice(pDevice),
         queueIndices(indices),
         deviceProperties(pDevice.getMemoryProperties()),
+        nonCoherentAtomSize(pDevice.getProperties().limits.nonCoherentAtomSize),
         device(device),
         transferQueue(transferQueue),
-        transferCommandPool(transferCommandPool) {}
+        transferCommandPool(transferCommandPool),
+        pools(std::make_shared<Pools>()) {}
+
+MemoryBlock::MemoryBlock(vk::DeviceMemory memory, vk::DeviceSize size, uint32_t memoryTypeIndex, void *mapped) :
+        memory(memory), size(size), memoryTypeIndex(memoryTypeIndex), mapped(mapped) {
+    freeRanges[0] = size;
+}
+
+vk::DeviceSize MemoryBlock::alloc(vk::DeviceSize len, vk::DeviceSize alignment) {
+    // first fit
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+        vk::DeviceSize rangeBegin = it->first;
+        vk::DeviceSize rangeEnd = it->first + it->second;
+        vk::DeviceSize begin = (rangeBegin + alignment - 1) / alignment * alignment;
+        if (begin + len > rangeEnd) {
+            continue;
+        }
+        freeRanges.erase(it);
+        if (begin > rangeBegin) {
+            freeRanges[rangeBegin] = begin - rangeBegin;
+        }
+        if (begin + len < rangeEnd) {
+            freeRanges[begin + len] = rangeEnd - begin - len;
+        }
+        return begin;
+    }
+    return size;
+}
+
+void MemoryBlock::release(vk::DeviceSize offset, vk::DeviceSize len) {
+    auto next = freeRanges.lower_bound(offset);
+    if (next != freeRanges.end() && offset + len == next->first) {
+        len += next->second;
+        next = freeRanges.erase(next);
+    }
+    if (next != freeRanges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += len;
+            return;
+        }
+    }
+    freeRanges[offset] = len;
+}
+
+bool MemoryBlock::empty() const {
+    return freeRanges.size() == 1 && freeRanges.begin()->second == size;
+}
 
 
 uint32_t MemoryAllocator::findMemoryType(
@@ -58,12 +117,70 @@ vk::DeviceMemory MemoryAllocator::allocateMemory(
                  "failed to allocate memory buffer!");
 }
 
-vk::DeviceMemory MemoryAllocator::allocateBufferMemory(const vk::Buffer &buffer,
-                                                       const vk::MemoryPropertyFlags flags) const {
+void MemoryAllocator::bindBufferMemory(BufferAllocation &allocation,
+                                       const vk::MemoryPropertyFlags flags) const {
 
     vk::MemoryRequirements memRequirements;
-    device.getBufferMemoryRequirements(buffer, &memRequirements);
-    return allocateMemory(memRequirements, flags);
+    device.getBufferMemoryRequirements(allocation.buffer, &memRequirements);
+    const uint32_t memoryType = findMemoryType(memRequirements.memoryTypeBits, flags);
+    allocation.memoryFlags = deviceProperties.memoryTypes[memoryType].propertyFlags;
+    const bool hostVisible = bool(allocation.memoryFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+
+    if (memRequirements.size > SUBALLOCATION_LIMIT) {
+        allocation.memory = allocateMemory(memRequirements, flags);
+        allocation.offset = 0;
+        if (hostVisible) {
+            allocation.mapped = CHECK(device.mapMemory(allocation.memory, 0, VK_WHOLE_SIZE), "unable to map memory!");
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(pools->mutex);
+        MemoryBlock *block = nullptr;
+        vk::DeviceSize offset = 0;
+        for (const std::unique_ptr<MemoryBlock> &candidate: pools->blocks) {
+            if (candidate->memoryTypeIndex != memoryType) {
+                continue;
+            }
+            offset = candidate->alloc(memRequirements.size, memRequirements.alignment);
+            if (offset != candidate->size) {
+                block = candidate.get();
+                break;
+            }
+        }
+        if (block == nullptr) {
+            vk::MemoryAllocateInfo allocInfo{};
+            allocInfo.sType = vk::StructureType::eMemoryAllocateInfo;
+            allocInfo.allocationSize = MEMORY_BLOCK_SIZE;
+            allocInfo.memoryTypeIndex = memoryType;
+            vk::DeviceMemory memory = CHECK(device.allocateMemory(allocInfo), "failed to allocate memory block!");
+            void *mapped = nullptr;
+            if (hostVisible) {
+                mapped = CHECK(device.mapMemory(memory, 0, VK_WHOLE_SIZE), "unable to map memory!");
+            }
+            pools->blocks.push_back(std::make_unique<MemoryBlock>(memory, MEMORY_BLOCK_SIZE, memoryType, mapped));
+            block = pools->blocks.back().get();
+            offset = block->alloc(memRequirements.size, memRequirements.alignment);
+        }
+        allocation.block = block;
+        allocation.blockRange = memRequirements.size;
+        allocation.memory = block->memory;
+        allocation.offset = offset;
+        if (hostVisible) {
+            allocation.mapped = static_cast<char *>(block->mapped) + offset;
+        }
+    }
+
+    CHECK(device.bindBufferMemory(allocation.buffer, allocation.memory, allocation.offset),
+          "failed to bind buffer memory!");
+}
+
+void MemoryAllocator::releaseMemory(const MemoryAllocation &allocation) const {
+    if (allocation.block == nullptr) {
+        device.freeMemory(allocation.memory);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(pools->mutex);
+    // blocks are kept for later buffers until destroy()
+    allocation.block->release(allocation.offset, allocation.blockRange);
 }
 
 BufferAllocation MemoryAllocator::createBuffer(
@@ -71,21 +188,18 @@ BufferAllocation MemoryAllocator::createBuffer(
         const vk::MemoryPropertyFlags flags,
         const size_t capacity) const {
 
-    vk::Buffer buffer;
-    vk::DeviceMemory memory;
-
     vk::BufferCreateInfo bufferInfo{};
     bufferInfo.sType = vk::StructureType::eBufferCreateInfo;
     bufferInfo.size = capacity;
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = vk::SharingMode::eExclusive;
 
-    buffer = CHECK(device.createBuffer(bufferInfo), "create buffer failed");
-    memory = allocateBufferMemory(buffer, flags);
-
-    CHECK(device.bindBufferMemory(buffer, memory, 0), "failed to bind buffer memory!");
+    BufferAllocation allocation;
+    allocation.capacity = capacity;
+    allocation.buffer = CHECK(device.createBuffer(bufferInfo), "create buffer failed");
+    bindBufferMemory(allocation, flags);
 
-    return BufferAllocation(memory, 0, capacity, buffer);
+    return allocation;
 }
 
 static void runCommandsSync(
@@ -136,6 +250,13 @@ bool AsyncCopyOp::isReady() const {
     }
 }
 
+void AsyncCopyOp::wait() {
+    if (pending) {
+        CHECK(device.waitForFences({transferFence}, true, -1), "wait for fence failed");
+        release();
+    }
+}
+
 void AsyncCopyOp::complete() {
     CHECK(pending, "copy operation already completed");
     release();
@@ -220,17 +341,11 @@ BufferAllocation MemoryAllocator::createDeviceLocalBuffer(
         const void *srcData,
         const vk::BufferUsageFlags usage) const {
 
-    // create staging buffer and fill it with data to transfer to GPU
-    BufferAllocation stagingBuffer = createStagingBuffer(srcData, bufferCapacity);
-
     // create device local buffer
     BufferAllocation deviceLocalBuffer = createDeviceLocalBuffer(bufferCapacity, usage);
 
-    // cannot be moved inside the lambda to avoid early destruction
-    copyBufferSync(stagingBuffer, deviceLocalBuffer);
-
-    // destroy staging buffer
-    stagingBuffer.free(*this);
+    // transfer the data through the staging ring
+    upload(deviceLocalBuffer, srcData, bufferCapacity);
 
     return deviceLocalBuffer;
 }
@@ -278,17 +393,227 @@ BufferAllocation MemoryAllocator::createDeviceLocalBuffer(const size_t bufferCap
 
 void BufferAllocation::fillWithStagingData(const vk::Device &device, const void *src, size_t len) const {
     CHECK(len <= capacity, "buffer overflow detected!");
+    CHECK(mapped != nullptr, "buffer is not host visible!");
+
+    // host visible memory stays mapped
+    std::memcpy(mapped, src, len);
+}
+
+void BufferAllocation::free(const MemoryAllocator &allocator) const {
+    allocator.device.destroyBuffer(buffer);
+    allocator.releaseMemory(*this);
+}
+
+vk::MemoryPropertyFlags MemoryAllocator::downloadStagingFlags() const {
+    const vk::MemoryPropertyFlags cached = vk::MemoryPropertyFlagBits::eHostVisible |
+                                           vk::MemoryPropertyFlagBits::eHostCached;
+    const vk::MemoryPropertyFlags coherent = vk::MemoryPropertyFlagBits::eHostVisible |
+                                             vk::MemoryPropertyFlagBits::eHostCoherent;
+    bool anyCached = false;
+    for (uint32_t i = 0; i < deviceProperties.memoryTypeCount; i++) {
+        const vk::MemoryPropertyFlags flags = deviceProperties.memoryTypes[i].propertyFlags;
+        if ((flags & (cached | coherent)) == (cached | coherent)) {
+            return cached | coherent;
+        }
+        anyCached |= (flags & cached) == cached;
+    }
+    return anyCached ? cached : coherent;
+}
+
+StagingSlot &MemoryAllocator::acquireStaging(const size_t capacity, const bool download) const {
+    StagingSlot *slot;
+    {
+        std::lock_guard<std::mutex> lock(pools->mutex);
+        std::vector<StagingSlot> &ring = download ? pools->downloadRing : pools->stagingRing;
+        size_t &nextSlot = download ? pools->nextDownloadSlot : pools->nextStagingSlot;
+        if (ring.empty()) {
+            ring.resize(STAGING_RING_SLOTS);
+            for (StagingSlot &s: ring) {
+                s.commands = allocateBuffer(device, transferCommandPool);
+                s.fence = createFence(device);
+            }
+        }
+        slot = &ring[nextSlot];
+        nextSlot = (nextSlot + 1) % STAGING_RING_SLOTS;
+    }
+
+    waitStaging(*slot);
+    if (slot->buffer.capacity < capacity) {
+        // slots only grow, such that repeated transfers of similar size do not allocate
+        if (slot->buffer.capacity > 0) {
+            slot->buffer.free(*this);
+        }
+        slot->buffer = createBuffer(vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+                                    download ? downloadStagingFlags()
+                                             : vk::MemoryPropertyFlagBits::eHostVisible |
+                                               vk::MemoryPropertyFlagBits::eHostCoherent,
+                                    capacity);
+        slot->coherent = bool(slot->buffer.memoryFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+    }
+    return *slot;
+}
+
+static void submitStagingCopy(const vk::Device &device, const vk::Queue &queue, StagingSlot &slot,
+                              const vk::Buffer &src, const vk::Buffer &dst, const vk::BufferCopy &copyRegion,
+                              const bool hostRead, const bool timed) {
+    CHECK(!slot.pending, "staging slot still in use");
+
+    if (timed && !slot.timestamps) {
+        vk::QueryPoolCreateInfo poolCreateInfo({}, vk::QueryType::eTimestamp, 2);
+        slot.timestamps = CHECK(device.createQueryPool(poolCreateInfo), "createQueryPool failed");
+    }
+    slot.timed = timed;
+    slot.transfer = hostRead ? "download" : "upload";
+    slot.bytes = copyRegion.size;
+    if (timed) {
+        device.resetQueryPool(slot.timestamps, 0, 2);
+    }
+
+    vk::CommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = vk::StructureType::eCommandBufferBeginInfo;
+    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
 
-    void *dst = CHECK(device.mapMemory(memory, offset, len),
-                      "unable to map memory!");
+    // the pool allows to rerecord the buffer of the slot
+    CHECK(slot.commands.begin(beginInfo), "failed to begin staging command buffer!");
     {
-        std::memcpy(dst, src, len);
+        if (timed) {
+            slot.commands.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, slot.timestamps, 0);
+        }
+        slot.commands.copyBuffer(src, dst, 1, &copyRegion);
+        if (timed) {
+            slot.commands.writeTimestamp(vk::PipelineStageFlagBits::eTransfer, slot.timestamps, 1);
+        }
+        if (hostRead) {
+            slot.commands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+                                          vk::DependencyFlags(),
+                                          {vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite,
+                                                             vk::AccessFlagBits::eHostRead)}, {}, {});
+        }
     }
-    device.unmapMemory(memory);
+    CHECK(slot.commands.end(), "failed to end staging command buffer!");
+
+    vk::SubmitInfo submitInfo{};
+    submitInfo.sType = vk::StructureType::eSubmitInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &slot.commands;
+    CHECK(queue.submit(submitInfo, slot.fence), "failed to submit to queue!");
+    slot.pending = true;
+}
 
+void MemoryAllocator::submitStagingUpload(StagingSlot &slot, const BufferAllocation &dst, const size_t len,
+                                          const vk::DeviceSize dstOffset) const {
+    vk::BufferCopy copyRegion(0ULL, dstOffset, len);
+    submitStagingCopy(device, transferQueue, slot, slot.buffer.buffer, dst.buffer, copyRegion, false,
+                      pools->trace != nullptr);
 }
 
-void BufferAllocation::free(const MemoryAllocator &allocator) const {
-    allocator.device.freeMemory(memory);
-    allocator.device.destroyBuffer(buffer);
+void MemoryAllocator::submitStagingDownload(StagingSlot &slot, const BufferAllocation &src, const size_t len,
+                                            const vk::DeviceSize srcOffset) const {
+    vk::BufferCopy copyRegion(srcOffset, 0ULL, len);
+    submitStagingCopy(device, transferQueue, slot, src.buffer, slot.buffer.buffer, copyRegion, true,
+                      pools->trace != nullptr);
+}
+
+void MemoryAllocator::waitStaging(StagingSlot &slot) const {
+    if (slot.pending) {
+        CHECK(device.waitForFences({slot.fence}, true, -1), "wait for fence failed");
+        CHECK(device.resetFences({slot.fence}), "failed to reset fence");
+        slot.pending = false;
+        if (slot.timed && pools->trace != nullptr) {
+            uint64_t ticks[2];
+            CHECK(device.getQueryPoolResults(slot.timestamps, 0, 2, sizeof(ticks), ticks, sizeof(uint64_t),
+                                             vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait),
+                  "getQueryPoolResults failed");
+            pools->trace->add(Trace::eTransfer, slot.transfer, pools->calibration.toHost(ticks[0]),
+                              pools->calibration.toHost(ticks[1]), {{"bytes", double(slot.bytes)}});
+        }
+        slot.timed = false;
+    }
+}
+
+void MemoryAllocator::invalidateStaging(const StagingSlot &slot) const {
+    if (slot.coherent) {
+        return;
+    }
+    // the range has to start and end at multiples of nonCoherentAtomSize, dedicated memory is mapped as a whole
+    const BufferAllocation &buffer = slot.buffer;
+    const vk::DeviceSize begin = buffer.offset / nonCoherentAtomSize * nonCoherentAtomSize;
+    const vk::DeviceSize end = (buffer.offset + buffer.capacity + nonCoherentAtomSize - 1) / nonCoherentAtomSize *
+                               nonCoherentAtomSize;
+    vk::MappedMemoryRange range(buffer.memory, begin, buffer.block != nullptr ? end - begin : VK_WHOLE_SIZE);
+    CHECK(device.invalidateMappedMemoryRanges({range}), "failed to invalidate staging memory");
+}
+
+void MemoryAllocator::traceTransfers(Trace *trace, const TimestampCalibration &calibration) const {
+    std::lock_guard<std::mutex> lock(pools->mutex);
+    pools->trace = trace;
+    pools->calibration = calibration;
+}
+
+void MemoryAllocator::waitAllStaging() const {
+    for (StagingSlot &slot: pools->stagingRing) {
+        waitStaging(slot);
+    }
+    for (StagingSlot &slot: pools->downloadRing) {
+        waitStaging(slot);
+    }
+}
+
+void MemoryAllocator::upload(const BufferAllocation &dst, const void *src, const size_t len,
+                             const vk::DeviceSize dstOffset) const {
+    for (size_t done = 0; done < len; done += STAGING_CHUNK_SIZE) {
+        const size_t part = std::min(STAGING_CHUNK_SIZE, len - done);
+        StagingSlot &slot = acquireStaging(part);
+        std::memcpy(slot.buffer.mapped, static_cast<const char *>(src) + done, part);
+        submitStagingUpload(slot, dst, part, dstOffset + done);
+    }
+    waitAllStaging();
+}
+
+void MemoryAllocator::download(const BufferAllocation &src, void *dst, const size_t len,
+                               const vk::DeviceSize srcOffset) const {
+    // the next part is already transferred while the previous one is copied out of its slot
+    StagingSlot *previous = nullptr;
+    size_t previousDone = 0;
+    size_t previousPart = 0;
+    for (size_t done = 0; done < len; done += STAGING_CHUNK_SIZE) {
+        const size_t part = std::min(STAGING_CHUNK_SIZE, len - done);
+        StagingSlot &slot = acquireStaging(part, true);
+        submitStagingDownload(slot, src, part, srcOffset + done);
+        if (previous != nullptr) {
+            waitStaging(*previous);
+            invalidateStaging(*previous);
+            std::memcpy(static_cast<char *>(dst) + previousDone, previous->buffer.mapped, previousPart);
+        }
+        previous = &slot;
+        previousDone = done;
+        previousPart = part;
+    }
+    if (previous != nullptr) {
+        waitStaging(*previous);
+        invalidateStaging(*previous);
+        std::memcpy(static_cast<char *>(dst) + previousDone, previous->buffer.mapped, previousPart);
+    }
+}
+
+void MemoryAllocator::destroy() {
+    if (!pools) {
+        return;
+    }
+    for (std::vector<StagingSlot> *ring: {&pools->stagingRing, &pools->downloadRing}) {
+        for (StagingSlot &slot: *ring) {
+            waitStaging(slot);
+            if (slot.buffer.capacity > 0) {
+                slot.buffer.free(*this);
+            }
+            device.destroyFence(slot.fence);
+            device.destroyQueryPool(slot.timestamps);
+            device.freeCommandBuffers(transferCommandPool, {slot.commands});
+        }
+        ring->clear();
+    }
+    for (const std::unique_ptr<MemoryBlock> &block: pools->blocks) {
+        device.freeMemory(block->memory);
+    }
+    pools->blocks.clear();
 }
@@ -9,6 +9,10 @@ void PipelineBuilder::addPushConstantRange(const vk::PushConstantRange &range) {
     pushConstantRanges.push_back(range);
 }
 
+void PipelineBuilder::setPipelineCache(const vk::PipelineCache &cache) {
+    pipelineCache = cache;
+}
+
 ComputePipelineBuilder::ComputePipelineBuilder(const Shader *shader)
         : PipelineBuilder(shader) {}
 
@@ -50,7 +54,7 @@ Pipeline ComputePipelineBuilder::buildSpecialization(const vk::Device &device,
     // create actual pipeline
     vk::ComputePipelineCreateInfo computeInfo(vk::PipelineCreateFlags(), computeShaderStageInfo, pipelineLayout);
 
-    const vk::Pipeline computePipeline = CHECK(device.createComputePipeline(VK_NULL_HANDLE, computeInfo),
+    const vk::Pipeline computePipeline = CHECK(device.createComputePipeline(pipelineCache, computeInfo),
                                                "unable to create compute pipeline");
 
     return Pipeline(nullptr, pipelineLayout, computePipeline);
@@ -1,17 +1,17 @@
 #include "app/shader.h"
+#include "app/embedded_shaders.h"
 #include "app/ioutil.h"
 #include "app/check.h"
 
 #include <vector>
 #include <cstring>
 
-static ShaderModule createShaderModule(const vk::Device &device, const std::string fileName,
+static ShaderModule createShaderModule(const vk::Device &device, const void *code, size_t size,
                                        vk::ShaderStageFlagBits flagBits) {
-    const std::vector<char> &code = readFile(fileName);
     vk::ShaderModuleCreateInfo createInfo{};
     createInfo.sType = vk::StructureType::eShaderModuleCreateInfo;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+    createInfo.codeSize = size;
+    createInfo.pCode = reinterpret_cast<const uint32_t *>(code);
 
     vk::ShaderModule m = CHECK(device.createShaderModule(createInfo), "failed to create shader module");
     return ShaderModule(m, flagBits);
@@ -20,11 +20,16 @@ static ShaderModule createShaderModule(const vk::Device &device, const std::stri
 Shader::Shader(const vk::Device &device, const char *shaderPath)
         : shaderName(shaderPath) {
 
-    const std::string shaderPathPrefix = "shaders/" + std::string(shaderPath);
-
-    // create shader modules from code
-    modules.push_back(createShaderModule(device, shaderPathPrefix + ".comp.spv",
-                                         vk::ShaderStageFlagBits::eCompute));
+    // the SPIR-V is compiled into the library, shaders that are not embedded are read relative to the working
+    // directory
+    const EmbeddedShader *embedded = findEmbeddedShader(shaderPath);
+    if (embedded != nullptr) {
+        modules.push_back(createShaderModule(device, embedded->code, embedded->size,
+                                             vk::ShaderStageFlagBits::eCompute));
+        return;
+    }
+    const std::vector<char> code = readFile("shaders/" + std::string(shaderPath) + ".comp.spv");
+    modules.push_back(createShaderModule(device, code.data(), code.size(), vk::ShaderStageFlagBits::eCompute));
 }
 
 std::vector<vk::PipelineShaderStageCreateInfo> Shader::shaderStages() const {
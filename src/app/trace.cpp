@@ -0,0 +1,76 @@
+#include "app/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+uint64_t Trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::add(Track track, std::string name, uint64_t begin, uint64_t end,
+                std::vector<std::pair<std::string, double>> args) {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back({track, std::move(name), begin, std::max(begin, end), std::move(args)});
+}
+
+std::vector<Trace::Event> Trace::getEvents() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return events;
+}
+
+void Trace::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+}
+
+static std::string escapeJson(const std::string &s) {
+    std::string res;
+    for (char c: s) {
+        if (c == '"' || c == '\\') {
+            res += '\\';
+        }
+        if (static_cast<unsigned char>(c) >= 0x20) {
+            res += c;
+        }
+    }
+    return res;
+}
+
+void Trace::writeJson(const std::string &filename) const {
+    static const char *TRACK_NAMES[] = {"host", "compute queue", "transfer queue"};
+    std::vector<Event> sorted = getEvents();
+    std::sort(sorted.begin(), sorted.end(), [](const Event &a, const Event &b) { return a.begin < b.begin; });
+    uint64_t origin = sorted.empty() ? 0 : sorted.front().begin;
+
+    std::ofstream out(filename);
+    if (!out.good()) {
+        throw std::runtime_error("failed to open file: " + filename);
+    }
+    out.precision(std::numeric_limits<double>::max_digits10);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    for (uint32_t track = eHost; track <= eTransfer; track++) {
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track
+            << ",\"args\":{\"name\":\"" << TRACK_NAMES[track] << "\"}},\n";
+    }
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const Event &e = sorted[i];
+        // complete events in microseconds
+        out << "{\"name\":\"" << escapeJson(e.name) << "\",\"cat\":\"" << TRACK_NAMES[e.track]
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.track
+            << ",\"ts\":" << double(e.begin - origin) / 1000.0
+            << ",\"dur\":" << double(e.end - e.begin) / 1000.0 << ",\"args\":{";
+        for (size_t a = 0; a < e.args.size(); a++) {
+            out << (a == 0 ? "" : ",") << "\"" << escapeJson(e.args[a].first) << "\":" << e.args[a].second;
+        }
+        out << "}}" << (i + 1 < sorted.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    out.close();
+    if (!out.good()) {
+        throw std::runtime_error("failed to write file: " + filename);
+    }
+}
@@ -28,7 +28,7 @@ namespace phobicgpu {
 
     void PartitionOffsetStage::addCommands(CommandBuffer *cb, uint32_t partitions, vk::Buffer bucketOffsets,
                                            vk::Buffer partitionOffsets) {
-        DescriptorSetAllocation desc = app.descrAlloc.alloc(partitionOffsetStage->descriptorLayouts[0]);
+        DescriptorSetAllocation desc = cb->descrAlloc.alloc(partitionOffsetStage->descriptorLayouts[0]);
         desc.updateStorageBuffer(0, partitionOffsets);
         desc.updateStorageBuffer(1, bucketOffsets);
 
@@ -28,13 +28,13 @@ namespace phobicgpu {
     BucketSizesStage::addCommands(CommandBuffer *cb, PushStructBucketSizes constants, vk::Buffer keys,
                                   vk::Buffer offsets,
                                   vk::Buffer counters, vk::Buffer debug, vk::Buffer fulcs) {
-        DescriptorSetAllocation desc0 = app.descrAlloc.alloc(bucketSizesStage->descriptorLayouts[0]);
+        DescriptorSetAllocation desc0 = cb->descrAlloc.alloc(bucketSizesStage->descriptorLayouts[0]);
         desc0.updateStorageBuffer(0, keys);
         desc0.updateStorageBuffer(1, offsets);
         desc0.updateStorageBuffer(2, counters);
         desc0.updateStorageBuffer(3, debug);
 
-        DescriptorSetAllocation desc1 = app.descrAlloc.alloc(bucketSizesStage->descriptorLayouts[1]);
+        DescriptorSetAllocation desc1 = cb->descrAlloc.alloc(bucketSizesStage->descriptorLayouts[1]);
         desc1.updateStorageBuffer(0, fulcs);
 
         cb->bindComputePipeline(bucketSizesStage->pipeline);
@@ -33,7 +33,7 @@ namespace phobicgpu {
     void BucketSortStage::addCommands(CommandBuffer *cb, PushStructBucketSort constants, vk::Buffer bucketSizes,
                                       size_t partitions, vk::Buffer debug, vk::Buffer histo, vk::Buffer partitionsSizes,
                                       vk::Buffer bucketSortPermutation) {
-        DescriptorSetAllocation desc = app.descrAlloc.alloc(bucketSortStage->descriptorLayouts[0]);
+        DescriptorSetAllocation desc = cb->descrAlloc.alloc(bucketSortStage->descriptorLayouts[0]);
         desc.updateStorageBuffer(0, bucketSizes);
         desc.updateStorageBuffer(1, debug);
         desc.updateStorageBuffer(2, histo);
@@ -0,0 +1,53 @@
+#include "phobicGpu/initial_hash_stage.h"
+
+namespace phobicgpu {
+
+    InitialHashStage::InitialHashStage(App &app, uint32_t workGroupSize) : app(app), workGroupSize(workGroupSize) {
+        if (!app.shaderInt64) {
+            return;
+        }
+        struct sc {
+            uint32_t a;
+            uint32_t b;
+        };
+        const Shader *shader = app.loadShader("initial_hash");
+        for (uint32_t stringKeys = 0; stringKeys < 2; stringKeys++) {
+            const ShaderStage *stage = app.computeStage(
+                    shader,
+                    {
+                            {
+                                    descr::storageBinding(0),
+                                    descr::storageBinding(1),
+                                    descr::storageBinding(2),
+                            }
+                    },
+                    PushConstants::ofStruct<PushStructInitialHash>(),
+                    {
+                            {0, sizeof(uint32_t) * 0, sizeof(uint32_t)},
+                            {1, sizeof(uint32_t) * 1, sizeof(uint32_t)},
+                    },
+                    sc{workGroupSize, stringKeys}
+            );
+            if (stringKeys) {
+                stringStage = stage;
+            } else {
+                integerStage = stage;
+            }
+        }
+    }
+
+    void InitialHashStage::addCommands(CommandBuffer *cb, PushStructInitialHash constants, bool stringKeys,
+                                       vk::Buffer raw, vk::Buffer offsets, vk::Buffer keys) {
+        const ShaderStage *stage = stringKeys ? stringStage : integerStage;
+        DescriptorSetAllocation desc = cb->descrAlloc.alloc(stage->descriptorLayouts[0]);
+        desc.updateStorageBuffer(0, raw);
+        desc.updateStorageBuffer(1, stringKeys ? offsets : raw);
+        desc.updateStorageBuffer(2, keys);
+
+        cb->bindComputePipeline(stage->pipeline);
+        cb->pushComputePushConstants(stage->pipeline, constants);
+        cb->bindComputeDescriptorSet(stage->pipeline, desc);
+        cb->dispatch((constants.size + workGroupSize - 1) / workGroupSize);
+    }
+
+}
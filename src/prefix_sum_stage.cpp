@@ -47,7 +47,7 @@ namespace phobicgpu {
             size = (size + workGroupSizeLocal * 2 - 1) / (workGroupSizeLocal * 2);
             BufferAllocation nextBuffer = app.memoryAlloc.createDeviceLocalBuffer(size * sizeof(uint32_t));
             data.buffers.push_back(nextBuffer);
-            DescriptorSetAllocation desc = app.descrAlloc.alloc(localStage->descriptorLayouts[0]);
+            DescriptorSetAllocation desc = cb->descrAlloc.alloc(localStage->descriptorLayouts[0]);
             desc.updateStorageBuffer(0, last);
             desc.updateStorageBuffer(1, nextBuffer.buffer);
             data.descriptors.push_back(desc);
@@ -55,7 +55,7 @@ namespace phobicgpu {
         }
 
         for (int i = data.buffers.size() - 3; i > -2; i--) {
-            DescriptorSetAllocation desc = app.descrAlloc.alloc(offsetStage->descriptorLayouts[0]);
+            DescriptorSetAllocation desc = cb->descrAlloc.alloc(offsetStage->descriptorLayouts[0]);
             desc.updateStorageBuffer(1, data.buffers[i + 1].buffer);
             desc.updateStorageBuffer(0, i == -1 ? work : data.buffers[i].buffer);
             data.offsetDescriptors.push_back(desc);
@@ -89,6 +89,9 @@ namespace phobicgpu {
         for (BufferAllocation &ba: buffers) {
             ba.free(allocator);
         }
+        buffers.clear();
+        descriptors.clear();
+        offsetDescriptors.clear();
     }
 
 }
\ No newline at end of file
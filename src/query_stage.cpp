@@ -0,0 +1,56 @@
+#include "phobicGpu/query_stage.h"
+
+#include <algorithm>
+
+namespace phobicgpu {
+
+    // the minimum of maxComputeWorkGroupCount[0] that every device supports
+    static constexpr uint32_t MAX_WORKGROUPS = 65535;
+
+    QueryStage::QueryStage(App &app, uint32_t workGroupSize) : app(app), workGroupSize(workGroupSize) {
+        queryStage = app.computeStage(
+                app.loadShader("query"),
+                {
+                        {
+                                descr::storageBinding(0),
+                                descr::storageBinding(1),
+                                descr::storageBinding(2),
+                                descr::storageBinding(3),
+                                descr::storageBinding(4),
+                                descr::storageBinding(5),
+                        },
+                        {
+                                descr::storageBinding(0)
+                        }
+                },
+                PushConstants::ofStruct<PushStructQuery>(),
+                {
+                        {0, 0, sizeof(uint32_t)}
+                },
+                workGroupSize
+        );
+    }
+
+    void QueryStage::addCommands(CommandBuffer *cb, PushStructQuery constants, vk::Buffer keys,
+                                 vk::Buffer partitionOffsets, vk::Buffer pilotColumns, vk::Buffer pilotBits,
+                                 vk::Buffer remap, vk::Buffer results, vk::Buffer fulcs) {
+        DescriptorSetAllocation desc0 = cb->descrAlloc.alloc(queryStage->descriptorLayouts[0]);
+        desc0.updateStorageBuffer(0, keys);
+        desc0.updateStorageBuffer(1, partitionOffsets);
+        desc0.updateStorageBuffer(2, pilotColumns);
+        desc0.updateStorageBuffer(3, pilotBits);
+        desc0.updateStorageBuffer(4, results);
+        desc0.updateStorageBuffer(5, remap);
+
+        DescriptorSetAllocation desc1 = cb->descrAlloc.alloc(queryStage->descriptorLayouts[1]);
+        desc1.updateStorageBuffer(0, fulcs);
+
+        cb->bindComputePipeline(queryStage->pipeline);
+        cb->pushComputePushConstants(queryStage->pipeline, constants);
+        cb->bindComputeDescriptorSet(queryStage->pipeline, desc0, 0);
+        cb->bindComputeDescriptorSet(queryStage->pipeline, desc1, 1);
+        uint32_t groups = (constants.size + workGroupSize - 1) / workGroupSize;
+        cb->dispatch(std::max(1u, std::min(groups, MAX_WORKGROUPS)));
+    }
+
+}
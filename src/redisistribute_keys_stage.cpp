@@ -28,13 +28,13 @@ namespace phobicgpu {
     void RedistributeKeysStage::addCommands(CommandBuffer *cb, PushStructRedistributeKeys constants,
                                             vk::Buffer keySrc, vk::Buffer lowerKeysDst, vk::Buffer bucketOffset,
                                             vk::Buffer keyOffset, vk::Buffer fulcs) {
-        DescriptorSetAllocation desc0 = app.descrAlloc.alloc(redistributeKeysStage->descriptorLayouts[0]);
+        DescriptorSetAllocation desc0 = cb->descrAlloc.alloc(redistributeKeysStage->descriptorLayouts[0]);
         desc0.updateStorageBuffer(0, keySrc);
         desc0.updateStorageBuffer(1, lowerKeysDst);
         desc0.updateStorageBuffer(2, bucketOffset);
         desc0.updateStorageBuffer(3, keyOffset);
 
-        DescriptorSetAllocation desc1 = app.descrAlloc.alloc(redistributeKeysStage->descriptorLayouts[1]);
+        DescriptorSetAllocation desc1 = cb->descrAlloc.alloc(redistributeKeysStage->descriptorLayouts[1]);
         desc1.updateStorageBuffer(0, fulcs);
 
         cb->bindComputePipeline(redistributeKeysStage->pipeline);
@@ -11,6 +11,8 @@ namespace phobicgpu {
             uint32_t c;
             uint32_t d;
             uint32_t e;
+            uint32_t f;
+            uint32_t g;
         };
         searchStage = app.computeStage(
                 app.loadShader("search"),
@@ -23,6 +25,7 @@ namespace phobicgpu {
                                 descr::storageBinding(4),
                                 descr::storageBinding(5),
                                 descr::storageBinding(6),
+                                descr::storageBinding(7),
                         }
                 },
                 {},
@@ -31,10 +34,12 @@ namespace phobicgpu {
                         {1, sizeof(uint32_t) * 1, sizeof(uint32_t)},
                         {2, sizeof(uint32_t) * 2, sizeof(uint32_t)},
                         {3, sizeof(uint32_t) * 3, sizeof(uint32_t)},
-                        {4, sizeof(uint32_t) * 4, sizeof(uint32_t)}
+                        {4, sizeof(uint32_t) * 4, sizeof(uint32_t)},
+                        {5, sizeof(uint32_t) * 5, sizeof(uint32_t)},
+                        {6, sizeof(uint32_t) * 6, sizeof(uint32_t)}
                 },
-                sc{workGroupSize, config.bucketCountPerPartition, config.sortingBins, config.partitionMaxSize(),
-                   config.sortingBins}
+                sc{workGroupSize, config.bucketCountPerPartition, config.sortingBins, config.partitionMaxSlots(),
+                   config.sortingBins, config.slotsPerMille, config.remapped()}
         );
 
     }
@@ -42,9 +47,9 @@ namespace phobicgpu {
     void SearchStage::addCommands(CommandBuffer *cb, uint32_t partitions,
                                   vk::Buffer keys, vk::Buffer bucketSizeHisto, vk::Buffer partitionSizes,
                                   vk::Buffer bucketPermuatation, vk::Buffer pilots, vk::Buffer partitionsOffsets,
-                                  vk::Buffer debug) {
+                                  vk::Buffer debug, vk::Buffer occupancy) {
 
-        DescriptorSetAllocation desc = app.descrAlloc.alloc(searchStage->descriptorLayouts[0]);
+        DescriptorSetAllocation desc = cb->descrAlloc.alloc(searchStage->descriptorLayouts[0]);
         desc.updateStorageBuffer(0, keys);
         desc.updateStorageBuffer(1, bucketSizeHisto);
         desc.updateStorageBuffer(2, partitionSizes);
@@ -52,6 +57,7 @@ namespace phobicgpu {
         desc.updateStorageBuffer(4, partitionsOffsets);
         desc.updateStorageBuffer(5, pilots);
         desc.updateStorageBuffer(6, debug);
+        desc.updateStorageBuffer(7, occupancy);
 
         cb->bindComputePipeline(searchStage->pipeline);
         cb->bindComputeDescriptorSet(searchStage->pipeline, desc);